@@ -0,0 +1,181 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Serial USB devices (ttyUSB) and their physical (topology based) USB address, shared by ttyusb2dev and vicread.
+// The links in /sys/class/tty point into the USB topology, e.g.
+//   ttyUSB0 -> ../../devices/platform/soc/3f980000.usb/usb1/1-1/1-1.1/1-1.1.3/1-1.1.3:1.0/ttyUSB0/tty/ttyUSB0
+// where 1-1.1.3 is the physical address. It stays the same when the adapter is plugged in again, the ttyUSB
+// number may not.
+
+#ifndef TTYUSB_H
+#define TTYUSB_H
+
+// C++ header files
+#include <climits>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Linux header files
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Default directory with the links of the tty devices. ttyusb2dev --sysfs can point to a fake tree for tests.
+inline constexpr const char *default_tty_class_directory = "/sys/class/tty";
+
+// The target of a link in a directory, empty if it isn't a link
+inline std::string read_link(int dirfd, const char *name) {
+    char target[PATH_MAX];
+    ssize_t n = readlinkat(dirfd, name, target, sizeof(target));
+    if (n <= 0 || static_cast<size_t>(n) >= sizeof(target))
+        return {};
+    return std::string(target, n);
+}
+
+// The targets of the ttyUSB* links in a directory, in a single pass with readdir(). The targets themselves are not
+// followed, so they don't have to exist.
+inline std::vector<std::string> list_ttyUSB_links(const std::string& directory) {
+    std::vector<std::string> result;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr)
+        return result;
+    while (const dirent *entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "ttyUSB", 6) != 0 || (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN))
+            continue;
+        auto target = read_link(dirfd(dir), entry->d_name);
+        if (!target.empty())
+            result.push_back(std::move(target));
+    }
+    closedir(dir);
+    return result;
+}
+
+// Extract the physical address and the ttyUSB device name from a link (or a sysfs device path). Returns false if the
+// link doesn't have them. The device name is the ttyUSB<n> at the end, the physical address is the last path element
+// in front of it that starts with <digits, '.', '-'> followed by a ':' (the USB interface, e.g. 1-1.1.3:1.0).
+inline bool parse_ttyUSB_link(std::string_view link, std::string& physical, std::string& device) {
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    auto is_address = [&](char c) { return is_digit(c) || c == '.' || c == '-'; };
+
+    // The regex matched the whole link with '.', which doesn't match a line terminator
+    if (link.find_first_of("\r\n") != std::string_view::npos)
+        return false;
+
+    size_t device_start = link.size();
+    while (device_start > 0 && is_digit(link[device_start - 1]))
+        device_start--;
+    if (device_start == link.size() || device_start < 6 || link.substr(device_start - 6, 6) != "ttyUSB")
+        return false;
+    device_start -= 6;
+
+    // Greedy like the regex this replaces: the last matching path element wins
+    for (size_t slash = device_start; slash-- > 0;) {
+        if (link[slash] != '/')
+            continue;
+        size_t end = slash + 1;
+        while (end < device_start && is_address(link[end]))
+            end++;
+        if (end > slash + 1 && end < device_start && link[end] == ':') {
+            physical = link.substr(slash + 1, end - slash - 1);
+            device = link.substr(device_start);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Physical USB address -> device name of all serial USB devices, e.g. 1-1.1.3 -> ttyUSB0
+using TtyUSBDevices = std::map<std::string, std::string>;
+
+inline TtyUSBDevices scan_ttyUSB_devices(const std::string& directory = default_tty_class_directory) {
+    TtyUSBDevices devices;
+    std::string physical, device;
+    for (const auto& link : list_ttyUSB_links(directory)) {
+        if (parse_ttyUSB_link(link, physical, device))
+            devices[physical] = device;
+    }
+    return devices;
+}
+
+// The device name (e.g. ttyUSB0) of a physical USB address (e.g. 1-1.1.3), empty if it isn't connected
+inline std::string find_ttyUSB_device(const std::string& physical_address, const std::string& directory = default_tty_class_directory) {
+    auto devices = scan_ttyUSB_devices(directory);
+    auto it = devices.find(physical_address);
+    return it == devices.end() ? std::string() : it->second;
+}
+
+// How a serial device given as a path or a name is checked. vicread opens the device itself right after the lookup,
+// so for vicread it only has to exist. ttyusb2dev only prints a device that can be opened (read only, as it always
+// did), so a node that exists but isn't a device it can open (e.g. a socket) is not found.
+enum class DeviceCheck {
+    Exists,
+    Opens
+};
+
+inline bool serial_device_ok(const std::string& path, DeviceCheck check) {
+    if (check == DeviceCheck::Exists)
+        return access(path.c_str(), F_OK) == 0;
+    // Non-blocking, so a tty without carrier doesn't block the open
+    int fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    close(fd);
+    return true;
+}
+
+// The path of a serial device given as a path or a name in /dev (e.g. ttyUSB0), empty if it doesn't exist (right now)
+inline std::string existing_serial_device(const std::string& name, DeviceCheck check = DeviceCheck::Exists) {
+    if (serial_device_ok(name, check))
+        return name;
+    if (name.find('/') == std::string::npos && serial_device_ok("/dev/" + name, check))
+        return "/dev/" + name;
+    return {};
+}
+
+// The path of a serial device given as a path, a name in /dev (e.g. ttyUSB0) or a physical USB address (e.g. 1-1.1.3),
+// with the physical addresses looked up in devices. Empty if it doesn't exist (right now).
+inline std::string resolve_serial_device(const std::string& name, const TtyUSBDevices& devices, DeviceCheck check = DeviceCheck::Exists) {
+    auto path = existing_serial_device(name, check);
+    if (!path.empty())
+        return path;
+    auto it = devices.find(name);
+    return it == devices.end() ? std::string() : "/dev/" + it->second;
+}
+
+// The same, the physical address is looked up in the directory only when needed
+inline std::string resolve_serial_device(const std::string& name, const std::string& directory = default_tty_class_directory) {
+    auto path = existing_serial_device(name);
+    if (!path.empty())
+        return path;
+    auto device = find_ttyUSB_device(name, directory);
+    return device.empty() ? device : "/dev/" + device;
+}
+
+#endif // TTYUSB_H
@@ -26,121 +26,404 @@
  */
 
 // C++ header files
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <iostream>
-#include <filesystem>
-#include <ranges>
+#include <iomanip>
+#include <string>
 #include <vector>
-#include <regex>
-
-// C++ header files
 
 // Linux header files
 #include <fcntl.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-static std::vector<std::string> list_ttyUSB_links(const std::string& directory) {
+#include "ttyusb.h"
 
-    namespace fs = std::filesystem;
+// Set by SIGINT/SIGTERM: stop the daemon (--watch)
+static volatile std::sig_atomic_t stop_requested = 0;
 
-    auto dir = fs::directory_iterator(directory);
+void handleStop(int signal) {
+    (void)signal;
+    stop_requested = 1;
+}
 
-    auto filter = [](const auto& entry) {
-        auto path = entry.path();
-        return fs::is_symlink(path) && path.filename().string().starts_with("ttyUSB");
-    };
+static void print_ttyUSB_list(const TtyUSBDevices& devices) {
 
-    auto transform = [](const auto& path) {
-        return fs::read_symlink(path).string();
-    };
+    constexpr int column_width = 16;
 
-    // Use ranges to filter and transform the directory entries
-    auto filtered = dir | std::views::filter(filter) | std::views::transform(transform);
+    // Loop over the ttyusb list
+    std::cerr << "Available ttyUSB device" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << std::left << std::setw(column_width) << "Physical" << "Device" << std::endl;
+    for (const auto& [physical, device] : devices)
+        std::cerr << std::left << std::setw(column_width) << physical << device << std::endl;
+}
 
-    // Create an empty vector
-    std::vector<std::string> result;
+static void print_usage(const char *program) {
+    std::cerr << "This application returns the full device path based on the device name or physical address of a serial USB device." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Usage: " << program << " [--sysfs=<dir>] [--socket=<path>] [ <device_name | physical_address> ... ]" << std::endl;
+    std::cerr << "       " << program << " [--sysfs=<dir>] --watch=<path>" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "device_name is the name of the serial USB device (e.g. ttyUSB0 or ttyUSB5)." << std::endl;
+    std::cerr << "physical_address is the topology based address of the serial USB device (e.g. 3-2.3 or 1-1.1.3)" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "In case the device exists, the full path to the device is sent to stdout" << std::endl;
+    std::cerr << "In case the device does not exists or no argument is provided, a list of all tty USB devices is printed" << std::endl;
+    std::cerr << "With more than one name all of them are resolved in one pass, one line per name in the same order" << std::endl;
+    std::cerr << "(an empty line for a name that is not found)." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --sysfs=<dir>       Directory with the tty device links (default " << default_tty_class_directory << "), e.g. a fake tree for tests" << std::endl;
+    std::cerr << "  --watch=<path>      Run as daemon: keep the physical address map up to date (uevents and inotify)" << std::endl;
+    std::cerr << "                      and answer lookups on the Unix socket <path>: one name per line, one path per line" << std::endl;
+    std::cerr << "  --socket=<path>     Ask the daemon on the Unix socket <path>, scan the directory if it isn't running" << std::endl;
+    std::cerr << std::endl;
+}
 
-    // We cannot return filtered directly because dir variable is out of scope (filtered refers to dir)
-    // So copy the filtered output to a vector of strings
-    for (const auto& item : filtered)
-        result.push_back(item);
+// Ask a running "ttyusb2dev --watch" for the paths of the names. Returns false if there is no daemon on the socket.
+static bool query_daemon(const std::string& socket_path, const std::vector<std::string>& names, std::vector<std::string>& paths) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        return false;
+    std::memcpy(addr.sun_path, socket_path.data(), socket_path.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return false;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return false;
+    }
 
-    return result;
+    std::string request;
+    for (const auto& name : names)
+        request += name + '\n';
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < request.size();) {
+        ssize_t n = send(fd, request.data() + pos, request.size() - pos, MSG_NOSIGNAL);
+        if (n > 0)
+            pos += n;
+        else if (n == -1 && errno != EINTR)
+            ok = false;
+    }
+    shutdown(fd, SHUT_WR);
+
+    std::string reply;
+    char buf[4096];
+    while (ok) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n > 0)
+            reply.append(buf, n);
+        else if (n == 0)
+            break;
+        else if (errno != EINTR)
+            ok = false;
+    }
+    close(fd);
+
+    paths.clear();
+    for (size_t pos = 0, nl; ok && (nl = reply.find('\n', pos)) != std::string::npos; pos = nl + 1)
+        paths.push_back(reply.substr(pos, nl - pos));
+    return ok && paths.size() == names.size();
 }
 
-static void print_ttyUSB_list(const std::vector<std::string>& ttyusblist) {
+// The daemon (--watch): the map of physical addresses is read once and then updated from the kernel uevents (netlink)
+// and from inotify on the directory (a fake tree for tests, sysfs itself doesn't send inotify events). A lookup costs
+// a map search instead of a directory scan.
+class Watcher {
+public:
+    explicit Watcher(const std::string& directory) : directory_(directory) {}
 
-    constexpr int column_width = 16;
+    ~Watcher() {
+        for (auto& client : clients_)
+            close(client.fd);
+        for (int fd : {listen_fd_, inotify_fd_, netlink_fd_}) {
+            if (fd != -1)
+                close(fd);
+        }
+        if (listen_fd_ != -1)
+            unlink(socket_path_.c_str());
+    }
 
-    // Extract the physical address and the ttyUSB device name
-    std::regex pattern(R"(^.*/([0-9.-]+):.*?(ttyUSB[0-9]+)$)");
-    std::smatch matches;
+    bool run(const std::string& socket_path) {
+        if (!listen_on(socket_path))
+            return false;
 
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ == -1 || inotify_add_watch(inotify_fd_, directory_.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) == -1) {
+            std::cerr << "Error watching \"" << directory_ << "\": " << strerror(errno) << std::endl;
+            return false;
+        }
+        // The uevents are about the real devices, so only with the real sysfs
+        if (directory_ == default_tty_class_directory && !open_netlink())
+            std::cerr << "Warning: no kernel uevents (" << strerror(errno) << "), devices are only updated by inotify" << std::endl;
 
-    // Loop over the ttyusb list
-    std::cerr << "Available ttyUSB device" << std::endl;
-    std::cerr << std::endl;
-    std::cerr << std::left << std::setw(column_width) << "Physical" << "Device" << std::endl;
-    for (const auto& device_link : ttyusblist) {
-        if (std::regex_search(device_link, matches, pattern)) {
-            std::cerr << std::left << std::setw(column_width) << matches[1] << matches[2] << std::endl;
+        devices_ = scan_ttyUSB_devices(directory_);
+        std::cerr << "Watching \"" << directory_ << "\" (" << devices_.size() << " serial USB devices), lookups on \"" << socket_path << "\"" << std::endl;
+
+        while (!stop_requested) {
+            std::vector<pollfd> fds = {{listen_fd_, POLLIN, 0}, {inotify_fd_, POLLIN, 0}, {netlink_fd_, POLLIN, 0}};
+            for (const auto& client : clients_)
+                fds.push_back({client.fd, POLLIN, 0});
+            if (poll(fds.data(), fds.size(), -1) == -1) {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "Error in poll(): " << strerror(errno) << std::endl;
+                return false;
+            }
+            if (fds[1].revents)
+                read_inotify();
+            if (fds[2].revents)
+                read_netlink();
+            // Clients before accept(), the indices of fds and clients_ match
+            for (size_t i = clients_.size(); i-- > 0;) {
+                if (fds[3 + i].revents && !serve(clients_[i])) {
+                    close(clients_[i].fd);
+                    clients_.erase(clients_.begin() + i);
+                }
+            }
+            if (fds[0].revents)
+                accept_clients();
         }
+        return true;
     }
-}
+
+private:
+    static constexpr size_t max_request_line = 4096;
+
+    struct Client {
+        int fd;
+        std::string request;            // Received, not yet complete line
+    };
+
+    bool listen_on(const std::string& socket_path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Error: invalid socket path \"" << socket_path << "\"" << std::endl;
+            return false;
+        }
+        std::memcpy(addr.sun_path, socket_path.data(), socket_path.size());
+        unlink(socket_path.c_str());     // Left behind by a previous run
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+            std::cerr << "Error listening on \"" << socket_path << "\": " << strerror(errno) << std::endl;
+            if (fd != -1)
+                close(fd);
+            return false;
+        }
+        listen_fd_ = fd;
+        socket_path_ = socket_path;
+        return true;
+    }
+
+    bool open_netlink() {
+        netlink_fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (netlink_fd_ == -1)
+            return false;
+        sockaddr_nl addr{};
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = 1;             // The uevents of the kernel
+        if (bind(netlink_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
+            int error = errno;
+            close(netlink_fd_);
+            netlink_fd_ = -1;
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
+    void add(const std::string& link) {
+        std::string physical, device;
+        if (!parse_ttyUSB_link(link, physical, device))
+            return;
+        remove(device);
+        devices_[physical] = device;
+        std::cerr << device << " added at " << physical << std::endl;
+    }
+
+    void remove(const std::string& device) {
+        std::erase_if(devices_, [&](const auto& entry) {
+            if (entry.second != device)
+                return false;
+            std::cerr << device << " removed from " << entry.first << std::endl;
+            return true;
+        });
+    }
+
+    void rescan() {
+        devices_ = scan_ttyUSB_devices(directory_);
+        std::cerr << "Rescanned \"" << directory_ << "\" (" << devices_.size() << " serial USB devices)" << std::endl;
+    }
+
+    void read_inotify() {
+        alignas(inotify_event) char buf[4096];
+        ssize_t n;
+        bool overflow = false;
+        while ((n = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+            for (ssize_t pos = 0; pos < n;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buf + pos);
+                pos += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW)
+                    overflow = true;
+                if (event->len == 0 || std::strncmp(event->name, "ttyUSB", 6) != 0)
+                    continue;
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    remove(event->name);
+                } else {
+                    int dirfd = open(directory_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    if (dirfd != -1) {
+                        add(read_link(dirfd, event->name));
+                        close(dirfd);
+                    }
+                }
+            }
+        }
+        if (overflow)
+            rescan();
+    }
+
+    // A uevent is "<action>@<devpath>" followed by KEY=value strings, all NUL terminated
+    void read_netlink() {
+        char buf[8192];
+        ssize_t n;
+        while ((n = recv(netlink_fd_, buf, sizeof(buf) - 1, 0)) != 0) {
+            if (n == -1) {
+                if (errno == ENOBUFS)   // Events lost
+                    rescan();
+                else if (errno != EINTR)
+                    return;
+                continue;
+            }
+            buf[n] = '\0';
+            std::string_view action, devpath, subsystem;
+            for (const char *p = buf; p < buf + n; p += std::strlen(p) + 1) {
+                std::string_view item(p);
+                if (item.starts_with("ACTION="))
+                    action = item.substr(7);
+                else if (item.starts_with("DEVPATH="))
+                    devpath = item.substr(8);
+                else if (item.starts_with("SUBSYSTEM="))
+                    subsystem = item.substr(10);
+            }
+            if (subsystem != "tty")
+                continue;
+            std::string physical, device;
+            if (action == "add")
+                add(std::string(devpath));
+            else if (action == "remove" && parse_ttyUSB_link(devpath, physical, device))
+                remove(device);
+        }
+    }
+
+    void accept_clients() {
+        int fd;
+        while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+            clients_.push_back({fd, {}});
+    }
+
+    // Answer the complete lines of a client. Returns false when the client is done (or misbehaves).
+    bool serve(Client& client) {
+        char buf[4096];
+        ssize_t n = read(client.fd, buf, sizeof(buf));
+        if (n == -1)
+            return errno == EAGAIN || errno == EINTR;
+        if (n == 0)
+            return false;
+        client.request.append(buf, n);
+
+        std::string reply;
+        size_t pos = 0;
+        for (size_t nl; (nl = client.request.find('\n', pos)) != std::string::npos; pos = nl + 1)
+            reply += resolve_serial_device(client.request.substr(pos, nl - pos), devices_, DeviceCheck::Opens) + '\n';
+        client.request.erase(0, pos);
+        if (client.request.size() > max_request_line)
+            return false;
+        // The replies are small and a client reads them, a client that doesn't is dropped
+        return send(client.fd, reply.data(), reply.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(reply.size());
+    }
+
+    std::string directory_;
+    std::string socket_path_;
+    int listen_fd_ = -1;
+    int inotify_fd_ = -1;
+    int netlink_fd_ = -1;
+    TtyUSBDevices devices_;
+    std::vector<Client> clients_;
+};
 
 int main(int argc, char *argv[])
 {
-    auto ttyusblist = list_ttyUSB_links("/sys/class/tty");
-
-    if (argc != 2) {
-        std::cerr << "This application returns the full device path based on the device name or physical address of a serial USB device." << std::endl;
-        std::cerr << std::endl;
-        std::cerr << "Usage: " << argv[0] << " [ <device_name | physical_address> ]" << std::endl;
-        std::cerr << std::endl;
-        std::cerr << "device_name is the name of the serial USB device (e.g. ttyUSB0 or ttyUSB5)." << std::endl;
-        std::cerr << "physical_address is the topology based address of the serial USB device (e.g. 3-2.3 or 1-1.1.3)" << std::endl;
-        std::cerr << std::endl;
-        std::cerr << "In case the device exists, the full path to the device is send to stdout" << std::endl;
-        std::cerr << "In case the device does not exists or no argument is provided, a list of all tty USB devices is printed" << std::endl;
-        std::cerr << std::endl;
-        print_ttyUSB_list(ttyusblist);
-        return -1;
+    std::string directory = default_tty_class_directory;
+    std::string watch_path, socket_path;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--sysfs=")) {
+            directory = arg.substr(8);
+        } else if (arg.starts_with("--watch=")) {
+            watch_path = arg.substr(8);
+        } else if (arg.starts_with("--socket=")) {
+            socket_path = arg.substr(9);
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Unknown option " << arg << std::endl;
+            std::cerr << std::endl;
+            print_usage(argv[0]);
+            return -1;
+        } else {
+            names.emplace_back(arg);
+        }
     }
 
-    // First try to open the device with the given name (as is)
-    int fd;
-    fd = open(argv[1], O_RDONLY | O_NOCTTY );   // Open the serial device in read only mode and don't make it the controlling terminal
-    if (fd >= 0) {
-        std::cout << argv[1] << std::endl;
-        close(fd);
-        return 0;
+    if (!watch_path.empty()) {
+        if (signal(SIGINT, handleStop) == SIG_ERR || signal(SIGTERM, handleStop) == SIG_ERR) {
+            std::cerr << "Failed to set up signal handler for SIGINT/SIGTERM" << std::endl;
+            return -1;
+        }
+        Watcher watcher(directory);
+        return watcher.run(watch_path) ? 0 : -1;
     }
 
-    // Next, add the /dev/ prefix and try to open the device
-    std::string device_name = "/dev/" + std::string(argv[1]);
-    fd = open(device_name.c_str(), O_RDONLY | O_NOCTTY );   // Open the serial device in read only mode and don't make it the controlling terminal
-    if (fd >= 0) {
-        std::cout << device_name << std::endl;
-        close(fd);
-        return 0;
+    if (names.empty()) {
+        print_usage(argv[0]);
+        print_ttyUSB_list(scan_ttyUSB_devices(directory));
+        return -1;
     }
 
-    // Last, try to find the device based on the physical address
-    std::regex pattern(R"(^.*/([0-9.-]+):.*?(ttyUSB[0-9]+)$)");
-    std::smatch matches;
+    // All names with a single scan of the directory (or a single request to the daemon)
+    std::vector<std::string> paths;
+    TtyUSBDevices devices;
+    bool scanned = false;
+    if (socket_path.empty() || !query_daemon(socket_path, names, paths)) {
+        devices = scan_ttyUSB_devices(directory);
+        scanned = true;
+        paths.clear();
+        for (const auto& name : names)
+            paths.push_back(resolve_serial_device(name, devices, DeviceCheck::Opens));
+    }
 
-    for (const auto& device_link : ttyusblist) {
-        if (std::regex_search(device_link, matches, pattern)) {
-            if (matches[1] == argv[1]) {
-                std::cout << "/dev/" << matches[2] << std::endl;
-                return 0;
-            }
+    bool found_all = true;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (paths[i].empty()) {
+            std::cerr << "Device \"" << names[i] << "\" not found" << std::endl;
+            found_all = false;
         }
+        if (!paths[i].empty() || names.size() > 1)
+            std::cout << paths[i] << std::endl;
     }
+    if (found_all)
+        return 0;
 
     // Not found, print the list of available devices
-    std::cerr << "Device \"" << argv[1] << "\" not found" << std::endl;
     std::cerr << std::endl;
-    print_ttyUSB_list(ttyusblist);
+    print_ttyUSB_list(scanned ? devices : scan_ttyUSB_devices(directory));
     return -1;
 }
- 
\ No newline at end of file
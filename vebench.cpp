@@ -0,0 +1,546 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// C++ header files
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+// C header files
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+// Linux header files
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "vedirect.h"
+#include "vegen.h"
+
+// Count every heap allocation, so we can show that the pipeline doesn't allocate per block.
+// The replacements are not inlined, otherwise GCC warns about free() on memory from operator new.
+static std::atomic<unsigned long> allocations{0};
+
+[[gnu::noinline]] void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// At 19200 baud (8N1 is 10 bits per byte) a device sends at most 1920 bytes per second
+static constexpr double device_bytes_per_second = 1920.0;
+
+// The benchmark feeds the stream in chunks of this size, like a read() from the serial device
+static constexpr std::size_t read_size = 512;
+
+struct Outcome {
+    unsigned long bytes = 0;
+    unsigned long valid_blocks = 0;
+    unsigned long chksum_errors = 0;
+    unsigned long format_errors = 0;
+    unsigned long recovered_blocks = 0;
+    unsigned long fields = 0;
+    std::chrono::duration<double> recovery_time{0};    // Spent in recover_block()
+};
+
+// Repair checksum errors like vicread --recover
+static bool recover_errors = false;
+
+// Run a stream through the same pipeline as vicread: the block parser and, for checksum errors, the recovery.
+// The fields of each valid block are decoded by the parser. on_valid_block() also gets whether the block was
+// recovered (recover_errors).
+template <typename ValidBlockHandler>
+static Outcome run_pipeline(std::string_view stream, ValidBlockHandler &&on_valid_block) {
+    Outcome outcome;
+    BlockParser parser;
+    parser.keep_errors(recover_errors);
+
+    std::string fixed;
+    Fields fixed_fields;
+    auto on_block = [&](const ParsedBlock &block) {
+        outcome.bytes += block.size;
+        auto status = block.status;
+        std::string_view text = block.text;
+        const Fields *fields = &block.fields;
+        bool recovered = false;
+        if (status == BlockStatus::ChecksumError && recover_errors && block.complete) {
+            auto start = std::chrono::steady_clock::now();
+            recovered = recover_block(block.text, fixed);
+            outcome.recovery_time += std::chrono::steady_clock::now() - start;
+            if (recovered) {
+                text = fixed;
+                fields = &fixed_fields;
+                status = decode_fields(check_block(fixed).lines, fixed_fields) ? BlockStatus::Valid : BlockStatus::FormatErrorFields;
+            }
+        }
+        switch (status) {
+        case BlockStatus::ChecksumError:
+            outcome.chksum_errors++;
+            return;
+        case BlockStatus::FormatErrorStart:
+        case BlockStatus::FormatErrorLine:
+        case BlockStatus::FormatErrorFields:
+        case BlockStatus::FormatErrorSize:
+            outcome.format_errors++;
+            return;
+        case BlockStatus::Valid:
+            break;
+        }
+        if (recovered)
+            outcome.recovered_blocks++;
+        else
+            outcome.valid_blocks++;
+        outcome.fields += fields->count;
+        on_valid_block(text, recovered);
+    };
+
+    for (std::size_t pos = 0; pos < stream.size(); pos += read_size)
+        parser.feed(stream.data() + pos, std::min(read_size, stream.size() - pos), on_block);
+    return outcome;
+}
+
+// The receive path of vicread before BlockParser, kept here to compare the throughput with (the scanner row):
+// a ring buffer and a scanner that finds the blocks, in front of check_block() and decode_fields().
+
+// Fixed capacity ring buffer, mapped twice in a row in the virtual address space.
+// Because of the mirror mapping the data between head and tail is always contiguous,
+// so blocks can be handed out as std::string_view without copying or moving them.
+class RingBuffer {
+public:
+    RingBuffer() = default;
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    ~RingBuffer() {
+        if (base_ != nullptr)
+            munmap(base_, 2 * capacity_);
+    }
+
+    // The capacity is rounded up to a multiple of the page size. Returns false (and sets errno) on failure.
+    bool init(std::size_t capacity) {
+        std::size_t page = sysconf(_SC_PAGESIZE);
+        capacity = (capacity + page - 1) / page * page;
+
+        int memfd = memfd_create("vebench-ringbuf", MFD_CLOEXEC);
+        if (memfd == -1)
+            return false;
+        if (ftruncate(memfd, capacity) != 0) {
+            close(memfd);
+            return false;
+        }
+        // Reserve twice the capacity, then map the same memory in both halves
+        void *base = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            close(memfd);
+            return false;
+        }
+        char *lower = static_cast<char *>(base);
+        if (mmap(lower, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, 0) == MAP_FAILED ||
+            mmap(lower + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, 0) == MAP_FAILED) {
+            munmap(base, 2 * capacity);
+            close(memfd);
+            return false;
+        }
+        close(memfd);   // The mappings keep the memory alive
+        base_ = lower;
+        capacity_ = capacity;
+        return true;
+    }
+
+    char *data() { return base_ + head_; }
+    std::size_t size() const { return tail_ - head_; }
+    char *write_ptr() { return base_ + tail_; }
+    std::size_t write_space() const { return capacity_ - size(); }
+    void commit(std::size_t n) { tail_ += n; }
+
+    void consume(std::size_t n) {
+        head_ += n;
+        if (head_ >= capacity_) {   // Continue in the lower mapping
+            head_ -= capacity_;
+            tail_ -= capacity_;
+        }
+    }
+
+private:
+    char *base_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t head_ = 0;
+    std::size_t tail_ = 0;
+};
+
+// A block is at most a few hundred bytes, this leaves plenty of room for HEX-messages and garbage
+static constexpr std::size_t ring_buffer_size = 64 * 1024;
+
+// Scan the received bytes for HEX-messages and complete blocks, in a single pass.
+// Scanning continues at offset scan, where the previous call stopped. Every complete block is handed
+// to on_block() as a view into the buffer, every HEX-message (including the newline) to on_hex() just before
+// it is removed. Returns the number of bytes at the start of the buffer that are no longer needed; scan is
+// updated relative to the new start.
+template <typename BlockHandler, typename HexHandler>
+static std::size_t scan_blocks(char *data, std::size_t size, std::size_t &scan, BlockHandler &&on_block, HexHandler &&on_hex) {
+    std::size_t start = 0;      // Start of the current block
+    std::size_t i = scan;
+    while (i < size) {
+        if (data[i] == ':') {
+            // From: VE.Direct-Protocol-3.32.pdf
+            // " Some products will send Asynchronous HEX-messages, starting with “:A” and ending with a
+            //   newline ‘\n’, on their own. These messages can interrupt a regular Text-mode frame. "
+            // The replies to HEX commands (vicread --poll) look the same, with another response code after the ':'.
+            // A checksum byte ':' is followed by the \r\n of the next block or by a HEX-message, never by a hex digit.
+            if (i + 1 == size)
+                break;          // Wait for the next byte
+            if ((data[i + 1] >= '0' && data[i + 1] <= '9') || (data[i + 1] >= 'A' && data[i + 1] <= 'F')) {
+                auto endhex = static_cast<char *>(memchr(data + i + 2, '\n', size - i - 2));
+                if (endhex == nullptr)
+                    break;      // Wait for the rest of the HEX-message
+                // Remove the HEX-message by moving the part of the current block in front of it (if any) over it
+                std::size_t len = endhex - (data + i) + 1;
+                on_hex(std::string_view(data + i, len));
+                memmove(data + start + len, data + start, i - start);
+                start += len;
+                i += len;
+                continue;
+            }
+        }
+        if (i - start >= constexpr_strlen("Checksum\t") && data[i - 1] == '\t' &&
+            memcmp(data + i - constexpr_strlen("Checksum\t"), "Checksum\t", constexpr_strlen("Checksum\t")) == 0) {
+            // Found the "Checksum" message so we know where a block ends, this is the checksum byte.
+            // Assume the start of a block is at the start (this probably not the case the first time when we start reading)
+            std::size_t end = i + 1;
+            on_block(std::string_view(data + start, end - start));
+            start = i = end;
+            continue;
+        }
+        i++;
+    }
+    scan = i - start;
+    return start;
+}
+
+template <typename BlockHandler>
+static std::size_t scan_blocks(char *data, std::size_t size, std::size_t &scan, BlockHandler &&on_block) {
+    return scan_blocks(data, size, scan, on_block, [](std::string_view) {});
+}
+
+// The same with the scanner in front of the parser: the ring buffer, scan_blocks(), check_block() and
+// decode_fields(), a pass over the block each. For comparison in the throughput benchmark only.
+static Outcome run_scanner_pipeline(std::string_view stream) {
+    Outcome outcome;
+    RingBuffer ringbuf;
+    if (!ringbuf.init(ring_buffer_size)) {
+        std::cerr << "Error allocating the receive buffer: " << std::strerror(errno) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::size_t scan = 0;
+    Fields fields;
+    auto on_block = [&](std::string_view block) {
+        outcome.bytes += block.size();
+        auto check = check_block(block);
+        if (check.status == BlockStatus::ChecksumError) {
+            outcome.chksum_errors++;
+        } else if (check.status != BlockStatus::Valid || !decode_fields(check.lines, fields)) {
+            outcome.format_errors++;
+        } else {
+            outcome.valid_blocks++;
+            outcome.fields += fields.count;
+        }
+    };
+
+    for (std::size_t pos = 0; pos < stream.size(); pos += read_size) {
+        auto n = std::min(read_size, stream.size() - pos);
+        std::memcpy(ringbuf.write_ptr(), stream.data() + pos, n);
+        ringbuf.commit(n);
+        ringbuf.consume(scan_blocks(ringbuf.data(), ringbuf.size(), scan, on_block));
+        if (ringbuf.write_space() == 0) {
+            ringbuf.consume(ringbuf.size());
+            scan = 0;
+        }
+    }
+    return outcome;
+}
+
+static const char *profile_name(Profile profile) {
+    switch (profile) {
+    case Profile::Mppt:
+        return "MPPT";
+    case Profile::SmartShunt:
+        return "SmartShunt";
+    case Profile::Bmv:
+        return "BMV";
+    }
+    return "?";
+}
+
+// Throughput of the parser with both validators and of the scanner on the same stream: bytes/s, blocks/s and heap
+// allocations per block
+static void benchmark_throughput(std::string_view stream) {
+    std::cout << std::left << std::setw(12) << "Pipeline" << std::right
+              << std::setw(12) << "MB/s" << std::setw(14) << "blocks/s" << std::setw(14) << "allocs/block"
+              << std::setw(16) << "devices/core" << std::endl;
+
+    for (const char *pipeline : {"parser", "regex", "scanner"}) {
+        use_regex_validator = std::string_view(pipeline) == "regex";
+        auto run = [&]() {
+            if (std::string_view(pipeline) == "scanner")
+                return run_scanner_pipeline(stream);
+            return run_pipeline(stream, [](std::string_view, bool) {});
+        };
+        run();      // Warm up (page faults, caches)
+
+        auto allocs_before = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        auto outcome = run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        auto allocs = allocations.load() - allocs_before;
+        auto blocks = outcome.valid_blocks + outcome.chksum_errors + outcome.format_errors;
+
+        std::cout << std::left << std::setw(12) << pipeline << std::right << std::fixed
+                  << std::setw(12) << std::setprecision(2) << stream.size() / elapsed.count() / 1e6
+                  << std::setw(14) << std::setprecision(0) << blocks / elapsed.count()
+                  << std::setw(14) << std::setprecision(4) << static_cast<double>(allocs) / blocks
+                  << std::setw(16) << std::setprecision(0) << stream.size() / elapsed.count() / device_bytes_per_second
+                  << std::endl;
+    }
+    use_regex_validator = false;
+}
+
+// Detection rate of each validator stage for one kind of corruption.
+// Every accepted block that isn't identical to a generated (clean) block is an undetected error.
+static void benchmark_detection(const char *name, GeneratorConfig config, unsigned long blocks) {
+    std::string stream;
+    std::unordered_set<std::string> clean_blocks;
+    unsigned long corrupted = 0;
+    for (Profile profile : {Profile::Mppt, Profile::SmartShunt, Profile::Bmv}) {
+        config.profile = profile;
+        Generator generator(config);
+        std::string clean;
+        for (unsigned long i = 0; i < blocks / 3; i++) {
+            corrupted += generator.next_block(stream, &clean) != Corruption::None;
+            clean_blocks.insert(clean);
+        }
+    }
+
+    unsigned long undetected = 0;
+    auto outcome = run_pipeline(stream, [&](std::string_view block, bool) {
+        undetected += !clean_blocks.contains(std::string(block));
+    });
+    auto errors = outcome.chksum_errors + outcome.format_errors + undetected;
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << corrupted
+              << std::setw(12) << outcome.chksum_errors << std::setw(8) << (errors ? 100.0 * outcome.chksum_errors / errors : 0.0) << "%"
+              << std::setw(12) << outcome.format_errors << std::setw(8) << (errors ? 100.0 * outcome.format_errors / errors : 0.0) << "%"
+              << std::setw(12) << undetected << std::setw(8) << (errors ? 100.0 * undetected / errors : 0.0) << "%"
+              << std::endl;
+}
+
+// What --recover does with the checksum errors of one kind of corruption: the blocks it repaired correctly, the
+// blocks it accepted that aren't identical to the generated block (false accepts) and the time it takes per
+// checksum error. A block with an undetectable corruption (e.g. 2 bit-7 flips) isn't counted as a false accept.
+static void benchmark_recovery(const char *name, GeneratorConfig config, unsigned long blocks) {
+    std::string stream;
+    std::unordered_set<std::string> clean_blocks;
+    for (Profile profile : {Profile::Mppt, Profile::SmartShunt, Profile::Bmv}) {
+        config.profile = profile;
+        Generator generator(config);
+        std::string clean;
+        for (unsigned long i = 0; i < blocks / 3; i++) {
+            generator.next_block(stream, &clean);
+            clean_blocks.insert(clean);
+        }
+    }
+
+    recover_errors = false;
+    auto before = run_pipeline(stream, [](std::string_view, bool) {});
+
+    recover_errors = true;
+    unsigned long correct = 0;
+    unsigned long false_accepts = 0;
+    auto after = run_pipeline(stream, [&](std::string_view block, bool recovered) {
+        if (!recovered)
+            return;
+        if (clean_blocks.contains(std::string(block)))
+            correct++;
+        else
+            false_accepts++;
+    });
+    recover_errors = false;
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << before.chksum_errors
+              << std::setw(12) << after.recovered_blocks << std::setw(8) << (before.chksum_errors ? 100.0 * after.recovered_blocks / before.chksum_errors : 0.0) << "%"
+              << std::setw(12) << correct
+              << std::setw(12) << false_accepts << std::setw(8) << (after.recovered_blocks ? 100.0 * false_accepts / after.recovered_blocks : 0.0) << "%"
+              << std::setw(12) << std::setprecision(1)
+              << (before.chksum_errors ? after.recovery_time.count() / before.chksum_errors * 1e6 : 0.0)
+              << std::endl;
+}
+
+static bool parse_option(std::string_view arg, std::string_view name, double &value) {
+    if (!arg.starts_with(name) || arg.size() == name.size())
+        return false;
+    value = std::strtod(std::string(arg.substr(name.size())).c_str(), nullptr);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    double size_mb = 16;
+    double blocks = 300000;
+    double seed = 1;
+    double generate = 0;
+    GeneratorConfig config;
+    config.hex_rate = 0.1;
+    config.bit_error_rate = 1e-4;
+    config.msb_flip_rate = 1e-3;
+    std::string profile = "mixed";
+
+    for (int argnr = 1; argnr < argc; argnr++) {
+        std::string_view arg = argv[argnr];
+        if (parse_option(arg, "--size=", size_mb) || parse_option(arg, "--blocks=", blocks) ||
+            parse_option(arg, "--seed=", seed) || parse_option(arg, "--hex-rate=", config.hex_rate) ||
+            parse_option(arg, "--bit-error-rate=", config.bit_error_rate) ||
+            parse_option(arg, "--msb-flip-rate=", config.msb_flip_rate)) {
+            continue;
+        } else if (arg == "--generate") {
+            generate = 1;
+        } else if (arg.starts_with("--profile=")) {
+            profile = arg.substr(constexpr_strlen("--profile="));
+        } else {
+            std::cerr << "This application benchmarks the VE.Direct reader pipeline of vicread on a synthetic VE.Direct stream." << std::endl;
+            std::cerr << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [<options>]" << std::endl;
+            std::cerr << std::endl;
+            std::cerr << "Options:" << std::endl;
+            std::cerr << "  --generate                 Write the synthetic stream to stdout instead of running the benchmark" << std::endl;
+            std::cerr << "  --profile=<profile>        mppt, shunt, bmv or mixed (default " << profile << ")" << std::endl;
+            std::cerr << "  --size=<MB>                Size of the stream for the throughput benchmark and --generate (default " << size_mb << ")" << std::endl;
+            std::cerr << "  --blocks=<n>               Number of blocks for the detection benchmark (default " << blocks << ")" << std::endl;
+            std::cerr << "  --hex-rate=<p>             Probability per block of an interleaved HEX-message (default " << config.hex_rate << ")" << std::endl;
+            std::cerr << "  --bit-error-rate=<p>       Probability per byte of a bit flip (default " << config.bit_error_rate << ")" << std::endl;
+            std::cerr << "  --msb-flip-rate=<p>        Probability per block of 2 bit-7 flips, undetectable by the checksum (default " << config.msb_flip_rate << ")" << std::endl;
+            std::cerr << "  --seed=<n>                 Seed of the random generator (default " << seed << ")" << std::endl;
+            return -1;
+        }
+    }
+    config.seed = static_cast<unsigned>(seed);
+
+    std::vector<Profile> profiles;
+    if (profile == "mppt")
+        profiles = {Profile::Mppt};
+    else if (profile == "shunt")
+        profiles = {Profile::SmartShunt};
+    else if (profile == "bmv")
+        profiles = {Profile::Bmv};
+    else if (profile == "mixed")
+        profiles = {Profile::Mppt, Profile::SmartShunt, Profile::Bmv};
+    else {
+        std::cerr << "Unknown profile: \"" << profile << "\"" << std::endl;
+        return -1;
+    }
+
+    // The stream for the throughput benchmark: the profiles take turns, like several devices
+    std::string stream;
+    {
+        std::size_t size = size_mb * 1e6;
+        std::vector<Generator> generators;
+        for (Profile p : profiles) {
+            config.profile = p;
+            generators.emplace_back(config);
+        }
+        stream.reserve(size + 4096);
+        for (std::size_t i = 0; stream.size() < size; i++)
+            generators[i % generators.size()].next_block(stream);
+    }
+
+    if (generate) {
+        for (std::size_t pos = 0; pos < stream.size();) {
+            ssize_t n = write(STDOUT_FILENO, stream.data() + pos, stream.size() - pos);
+            if (n <= 0) {
+                std::cerr << "Error writing the stream: " << std::strerror(errno) << std::endl;
+                return -1;
+            }
+            pos += n;
+        }
+        return 0;
+    }
+
+    std::cout << "Throughput, " << stream.size() / 1e6 << " MB, profile " << profile
+              << ", HEX-message rate " << config.hex_rate << ", bit error rate " << config.bit_error_rate
+              << ", bit-7 double flip rate " << config.msb_flip_rate << std::endl;
+    std::cout << std::endl;
+    benchmark_throughput(stream);
+    std::cout << std::endl;
+
+    std::cout << "Detection per validator stage, " << static_cast<unsigned long>(blocks) << " blocks of ";
+    for (Profile p : {Profile::Mppt, Profile::SmartShunt, Profile::Bmv})
+        std::cout << profile_name(p) << (p == Profile::Bmv ? "" : ", ");
+    std::cout << " (percentages of all detected and undetected errors)" << std::endl;
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(20) << "Corruption" << std::right << std::setw(12) << "injected"
+              << std::setw(21) << "checksum" << std::setw(21) << "grammar" << std::setw(21) << "undetected" << std::endl;
+
+    GeneratorConfig bit_errors = config;
+    bit_errors.msb_flip_rate = 0.0;
+    bit_errors.bit_error_rate = config.bit_error_rate > 0.0 ? config.bit_error_rate : 1e-4;
+    benchmark_detection("bit errors", bit_errors, blocks);
+
+    GeneratorConfig msb_flips = config;
+    msb_flips.bit_error_rate = 0.0;
+    msb_flips.msb_flip_rate = config.msb_flip_rate > 0.0 ? config.msb_flip_rate : 1e-3;
+    benchmark_detection("bit-7 double flips", msb_flips, blocks);
+    std::cout << std::endl;
+
+    std::cout << "Recovery of checksum errors (--recover), " << static_cast<unsigned long>(blocks) << " blocks"
+              << " (false accepts: recovered blocks that differ from the sent block)" << std::endl;
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(20) << "Corruption" << std::right << std::setw(12) << "checksum"
+              << std::setw(21) << "recovered" << std::setw(12) << "correct" << std::setw(21) << "false accepts"
+              << std::setw(12) << "us/error" << std::endl;
+    benchmark_recovery("bit errors", bit_errors, blocks);
+    GeneratorConfig heavy = bit_errors;
+    heavy.bit_error_rate *= 10;
+    benchmark_recovery("10x bit errors", heavy, blocks);
+    return 0;
+}
@@ -0,0 +1,396 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Binary output format of vicread (--format=binary), for high-volume ingestion.
+// The stream is a sequence of length-prefixed records. All integers are little endian.
+//
+// Every record starts with an 8 byte header:
+//   offset size
+//   0      4    length          Total length of the record in bytes, including this header
+//   4      1    version         Format version, currently 1. Readers skip records with an unknown version.
+//   5      1    type            1 = device, 2 = block, 3 = window, 4 = HEX (readers skip unknown types)
+//   6      2    device_id       Index of the device on the vicread command line
+//
+// Device record (type 1), sent once per device before its first block:
+//   8      1    flags           Bit 0: the text output has the device label in front of every line
+//   9      ...  label           The device label (length - 9 bytes)
+//
+// Block record (type 2), one per validated block:
+//   8      8    monotonic_ns    CLOCK_MONOTONIC when the block was processed
+//   16     8    realtime_ns     CLOCK_REALTIME (ns since the epoch) when the block was processed
+//   24     2    field_count
+//   26     ...  fields
+//
+// Field:
+//   0      2    field_id        Index in the field dictionary (vedirect.h), 0xFFFF for an unknown label
+//   [2     2    name_length     Only for an unknown label, followed by the label itself]
+//   +0     1    kind            0 = number, 1 = hex, 2 = on/off, 3 = text
+//   +1     2    size            hex: number of hex digits, text: length of the text, otherwise 0
+//   +3     ...  value           number, hex, on/off: 8 byte signed integer; text: size bytes
+//
+// Window record (type 3), one per aggregation window (--aggregate) with at least 1 value:
+//   8      8    monotonic_ns    CLOCK_MONOTONIC when the window was closed
+//   16     8    start_ns        CLOCK_REALTIME start of the window
+//   24     8    end_ns          CLOCK_REALTIME end of the window
+//   32     8    energy_mwh      Energy integrated from P, in mWh
+//   40     1    flags           Bit 0: energy_mwh is valid (P was received)
+//   41     2    field_count
+//   43     ...  fields, 38 bytes each:
+//                 0   2  field_id
+//                 2   4  count
+//                 6   8  sum        (the mean is sum / count)
+//                 14  8  min
+//                 22  8  max
+//                 30  8  last
+//
+// HEX record (type 4), one per register message of the HEX protocol (--hex, see vehex.h):
+//   8      8    monotonic_ns    CLOCK_MONOTONIC when the message was received
+//   16     8    realtime_ns     CLOCK_REALTIME when the message was received
+//   24     1    command         The response code, e.g. 0xA for an asynchronous update
+//   25     1    size            Number of data bytes
+//   26     ...  data            As received: register id (2 bytes), flags (1 byte), value (little endian)
+//
+// Numbers are only sent as kind number when the text can be reproduced exactly (no leading zeros),
+// so a decoder produces exactly the text output of vicread.
+
+#ifndef VEBINARY_H
+#define VEBINARY_H
+
+// C++ header files
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
+#include <type_traits>
+
+// C header files
+#include <cstdint>
+#include <cstring>
+
+#include "vedirect.h"
+#include "vehex.h"
+
+inline constexpr std::uint8_t binary_version = 1;
+inline constexpr std::size_t binary_header_size = 8;
+inline constexpr std::uint16_t binary_unknown_field = 0xFFFF;
+
+enum class RecordType : std::uint8_t {
+    Device = 1,
+    Block = 2,
+    Window = 3,
+    Hex = 4
+};
+
+enum class ValueKind : std::uint8_t {
+    Number = 0,
+    Hex = 1,
+    OnOff = 2,
+    Text = 3
+};
+
+template <typename T>
+inline void append_le(std::string &out, T value) {
+    auto u = static_cast<std::make_unsigned_t<T>>(value);
+    for (std::size_t i = 0; i < sizeof(T); i++)
+        out += static_cast<char>((u >> (8 * i)) & 0xFF);
+}
+
+template <typename T>
+inline T read_le(const char *p) {
+    std::make_unsigned_t<T> u = 0;
+    for (std::size_t i = 0; i < sizeof(T); i++)
+        u |= static_cast<std::make_unsigned_t<T>>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return static_cast<T>(u);
+}
+
+inline void begin_record(std::string &out, RecordType type, std::uint16_t device_id) {
+    out.clear();
+    append_le<std::uint32_t>(out, 0);   // The length is filled in by end_record()
+    out += static_cast<char>(binary_version);
+    out += static_cast<char>(type);
+    append_le(out, device_id);
+}
+
+inline void end_record(std::string &out) {
+    auto length = static_cast<std::uint32_t>(out.size());
+    for (std::size_t i = 0; i < 4; i++)
+        out[i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+}
+
+inline void encode_device_record(std::string &out, std::uint16_t device_id, bool labels, std::string_view label) {
+    begin_record(out, RecordType::Device, device_id);
+    out += static_cast<char>(labels ? 1 : 0);
+    out += label;
+    end_record(out);
+}
+
+// The kind a field is sent as (see the top of this file)
+inline ValueKind value_kind(const Field &field) {
+    if (!field.numeric)
+        return ValueKind::Text;
+    switch (field_dictionary[field.id].type) {
+    case FieldType::Hex:
+        // format_value() handles up to 30 digits (leading zeros included)
+        return field.value.size() <= 32 ? ValueKind::Hex : ValueKind::Text;
+    case FieldType::OnOff:
+        return ValueKind::OnOff;
+    default: {
+        // Only when the decimal text can be reproduced exactly
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), field.number);
+        return std::string_view(buf, res.ptr - buf) == field.value ? ValueKind::Number : ValueKind::Text;
+    }
+    }
+}
+
+// Encode a block record with the fields for which accept(field) is true.
+// out is reused between calls, so in the steady state this doesn't allocate.
+template <typename Accept>
+inline void encode_block_record(std::string &out, std::uint16_t device_id, std::int64_t monotonic_ns, std::int64_t realtime_ns,
+                                const Fields &fields, Accept &&accept) {
+    begin_record(out, RecordType::Block, device_id);
+    append_le(out, monotonic_ns);
+    append_le(out, realtime_ns);
+    std::size_t count_pos = out.size();
+    append_le<std::uint16_t>(out, 0);
+    std::uint16_t count = 0;
+    for (auto const &field : fields) {
+        if (!accept(field))
+            continue;
+        count++;
+        if (field.id == unknown_field) {
+            append_le(out, binary_unknown_field);
+            append_le(out, static_cast<std::uint16_t>(field.name.size()));
+            out += field.name;
+        } else {
+            append_le(out, static_cast<std::uint16_t>(field.id));
+        }
+        auto kind = value_kind(field);
+        out += static_cast<char>(kind);
+        switch (kind) {
+        case ValueKind::Text:
+            append_le(out, static_cast<std::uint16_t>(field.value.size()));
+            out += field.value;
+            break;
+        case ValueKind::Hex:
+            append_le(out, static_cast<std::uint16_t>(field.value.size() - 2));   // Without the "0x"
+            append_le(out, field.number);
+            break;
+        default:
+            append_le<std::uint16_t>(out, 0);
+            append_le(out, field.number);
+            break;
+        }
+    }
+    out[count_pos] = static_cast<char>(count & 0xFF);
+    out[count_pos + 1] = static_cast<char>(count >> 8);
+    end_record(out);
+}
+
+inline void encode_window_record(std::string &out, std::uint16_t device_id, std::int64_t monotonic_ns, const Aggregator &window) {
+    begin_record(out, RecordType::Window, device_id);
+    append_le(out, monotonic_ns);
+    append_le(out, window.start_ns);
+    append_le(out, window.end_ns);
+    append_le(out, window.energy_mwh());
+    out += static_cast<char>(window.has_energy ? 1 : 0);
+    append_le(out, static_cast<std::uint16_t>(window.present.count()));
+    for (int id = 0; id < field_count; id++) {
+        if (!window.present.test(id))
+            continue;
+        auto const &acc = window.fields[id];
+        append_le(out, static_cast<std::uint16_t>(id));
+        append_le(out, acc.count);
+        append_le(out, acc.sum);
+        append_le(out, acc.min);
+        append_le(out, acc.max);
+        append_le(out, acc.last);
+    }
+    end_record(out);
+}
+
+inline void encode_hex_record(std::string &out, std::uint16_t device_id, std::int64_t monotonic_ns, std::int64_t realtime_ns,
+                              const HexMessage &message) {
+    begin_record(out, RecordType::Hex, device_id);
+    append_le(out, monotonic_ns);
+    append_le(out, realtime_ns);
+    out += static_cast<char>(message.command);
+    out += static_cast<char>(message.size);
+    out.append(reinterpret_cast<const char *>(message.data.data()), message.size);
+    end_record(out);
+}
+
+// Reading the binary format
+
+struct RecordHeader {
+    std::uint32_t length;
+    std::uint8_t version;
+    RecordType type;
+    std::uint16_t device_id;
+};
+
+struct DecodedField {
+    int id;                             // Field id or unknown_field
+    std::string_view name;
+    ValueKind kind;
+    std::int64_t number;
+    int hex_digits;
+    std::string_view text;
+};
+
+// Returns the length of the first record in data, 0 when data doesn't hold a complete record yet.
+inline std::size_t next_record(std::string_view data, RecordHeader &header) {
+    if (data.size() < binary_header_size)
+        return 0;
+    header.length = read_le<std::uint32_t>(data.data());
+    header.version = data[4];
+    header.type = static_cast<RecordType>(data[5]);
+    header.device_id = read_le<std::uint16_t>(data.data() + 6);
+    if (header.length < binary_header_size || data.size() < header.length)
+        return 0;
+    return header.length;
+}
+
+// Decode the fields of a block record (version 1) and hand them to on_field(). Returns false on a corrupt record.
+template <typename FieldHandler>
+inline bool decode_block_record(std::string_view record, std::int64_t &monotonic_ns, std::int64_t &realtime_ns, FieldHandler &&on_field) {
+    if (record.size() < 26)
+        return false;
+    monotonic_ns = read_le<std::int64_t>(record.data() + 8);
+    realtime_ns = read_le<std::int64_t>(record.data() + 16);
+    auto count = read_le<std::uint16_t>(record.data() + 24);
+    record.remove_prefix(26);
+    for (unsigned i = 0; i < count; i++) {
+        DecodedField field{};
+        if (record.size() < 2)
+            return false;
+        auto id = read_le<std::uint16_t>(record.data());
+        record.remove_prefix(2);
+        if (id == binary_unknown_field) {
+            if (record.size() < 2u + read_le<std::uint16_t>(record.data()))
+                return false;
+            field.id = unknown_field;
+            field.name = record.substr(2, read_le<std::uint16_t>(record.data()));
+            record.remove_prefix(2 + field.name.size());
+        } else if (id < field_count) {
+            field.id = id;
+            field.name = field_dictionary[id].label;
+        } else {
+            return false;
+        }
+        if (record.size() < 3)
+            return false;
+        field.kind = static_cast<ValueKind>(record[0]);
+        std::size_t size = read_le<std::uint16_t>(record.data() + 1);
+        record.remove_prefix(3);
+        if (field.kind > ValueKind::Text)
+            return false;
+        if (field.kind == ValueKind::Text) {
+            if (record.size() < size)
+                return false;
+            field.text = record.substr(0, size);
+            record.remove_prefix(size);
+        } else {
+            if (record.size() < 8)
+                return false;
+            field.number = read_le<std::int64_t>(record.data());
+            field.hex_digits = size;
+            record.remove_prefix(8);
+        }
+        on_field(field);
+    }
+    return true;
+}
+
+// Decode a window record (version 1). Returns false on a corrupt record.
+inline bool decode_window_record(std::string_view record, std::int64_t &monotonic_ns, Aggregator &window) {
+    if (record.size() < 43)
+        return false;
+    monotonic_ns = read_le<std::int64_t>(record.data() + 8);
+    window.reset(read_le<std::int64_t>(record.data() + 16), read_le<std::int64_t>(record.data() + 24));
+    window.energy_ws = read_le<std::int64_t>(record.data() + 32) * 3.6;
+    window.has_energy = record[40] & 1;
+    auto count = read_le<std::uint16_t>(record.data() + 41);
+    if (record.size() != 43u + 38u * count)
+        return false;
+    for (const char *p = record.data() + 43; count > 0; count--, p += 38) {
+        auto id = read_le<std::uint16_t>(p);
+        if (id >= field_count)
+            return false;
+        auto &acc = window.fields[id];
+        window.present.set(id);
+        acc.count = read_le<std::uint32_t>(p + 2);
+        acc.sum = read_le<std::int64_t>(p + 6);
+        acc.min = read_le<std::int64_t>(p + 14);
+        acc.max = read_le<std::int64_t>(p + 22);
+        acc.last = read_le<std::int64_t>(p + 30);
+    }
+    return true;
+}
+
+// Decode a HEX record (version 1). Returns false on a corrupt record.
+inline bool decode_hex_record(std::string_view record, std::int64_t &monotonic_ns, std::int64_t &realtime_ns, HexMessage &message) {
+    if (record.size() < 26)
+        return false;
+    monotonic_ns = read_le<std::int64_t>(record.data() + 8);
+    realtime_ns = read_le<std::int64_t>(record.data() + 16);
+    message.command = record[24];
+    message.size = static_cast<unsigned char>(record[25]);
+    if (message.size > hex_max_data || record.size() != 26 + message.size)
+        return false;
+    std::memcpy(message.data.data(), record.data() + 26, message.size);
+    return true;
+}
+
+// Format the value of a decoded field exactly like the VE.Direct text (and the text output of vicread)
+inline std::string_view format_value(const DecodedField &field, char (&buf)[32]) {
+    switch (field.kind) {
+    case ValueKind::Number: {
+        auto res = std::to_chars(buf, buf + sizeof(buf), field.number);
+        return std::string_view(buf, res.ptr - buf);
+    }
+    case ValueKind::Hex: {
+        static constexpr char hexdigits[] = "0123456789ABCDEF";
+        int digits = std::min(field.hex_digits, static_cast<int>(sizeof(buf)) - 2);
+        auto u = static_cast<std::uint64_t>(field.number);
+        buf[0] = '0';
+        buf[1] = 'x';
+        for (int i = digits - 1; i >= 0; i--) {
+            buf[2 + i] = hexdigits[u & 0x0F];
+            u >>= 4;
+        }
+        return std::string_view(buf, 2 + digits);
+    }
+    case ValueKind::OnOff:
+        return field.number ? "ON" : "OFF";
+    case ValueKind::Text:
+        return field.text;
+    }
+    return {};
+}
+
+#endif // VEBINARY_H
@@ -0,0 +1,1121 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// The VE.Direct text protocol: the grammar, the block parser and the recovery of a single bit flip.
+// Shared by vicread and vebench, so the benchmark measures exactly the code that vicread runs.
+
+#ifndef VEDIRECT_H
+#define VEDIRECT_H
+
+// C++ header files
+#include <regex>
+#include <array>
+#include <string_view>
+#include <string>
+#include <vector>
+#include <bitset>
+#include <charconv>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <memory>
+
+// C header files
+#include <cstring>
+#include <cstdint>
+
+#define constexpr_strlen(s) (sizeof(s) - 1) // The -1 is to exclude the null terminator
+
+// The VE.Direct protocol is described in the VE.Direct Protocol Specification
+// document. The document is available from Victron Energy.
+//
+// The grammer below is based on observations of 5 VE.Direct devices.
+// 1) SmartShunt 500A/50mV
+// 2) SmartSolar MPPT 150/85 rev2
+// 3) SmartSolar MPPT 150|70 rev2
+// 4) SmartSolar MPPT 100|50
+// 5) BMV-712 Smart - Battery monitor (BMV)
+//
+// THERE WILL BE DEVICES NOT MEETING THIS GRAMMAR!
+//
+// BNF Grammar:
+// <ve_direct_line> ::= <capitalized-name> <TAB> <number-value> <CRLF>
+//                   | <capitalized-name> <TAB> <hex-value> <CRLF>
+//                   | <capitalized-name> <TAB> "ON" <CRLF>
+//                   | <capitalized-name> <TAB> "OFF" <CRLF>
+//                   | <capitalized-name> <TAB> "---" <CRLF>
+//                   | "BMV" <TAB> <capitalized-string-value> <CRLF>
+//                   | "SER#" <TAB> <capitalized-string-value> <CRLF>
+//                   | "FWE" <TAB> <capitalized-string-value> <CRLF>
+//
+// <capitalized-name> ::= <uppercase-letter> <capitalized-name-rest>*
+// <capitalized-name-rest> ::= <uppercase-letter>
+//                          | <lowercase-letter>
+//                          | <digit>
+//
+// <capitalized-string-value> ::= <uppercase-letter> <capitalized-string-value-rest>*
+//                             | <digit> <capitalized-string-value-rest>*
+// <capitalized-string-value-rest> ::= <uppercase-letter>
+//                                  | <lowercase-letter>
+//                                  | <digit>
+//                                  | "/"
+//                                  | " "
+//
+// <TAB> ::= "\t"
+// <CRLF> ::= "\r\n"
+//
+// <number-value> ::= <signed-integer>
+// <signed-integer> ::= <digit>+
+//                   | "-" <digit>+
+//
+// <hex-value> ::= "0x" <hex-digit>+
+//
+// <uppercase-letter> ::= "A" | "B" | "C" | ... | "Z"
+// <lowercase-letter> ::= "a" | "b" | "c" | ... | "z"
+// <digit> ::= "0" | "1" | "2" | ... | "9"
+// <hex-digit> ::= <digit> | "A" | "B" | "C" | "D" | "E" | "F"
+
+
+// Regex pattern explanation:
+// ^ and $: Anchor the pattern to the start and end of the line.
+// (?: ...): Non-capturing group.
+// [A-Z][A-Za-z0-9]*: Matches a capitalized name.
+// \t: Matches a tab character.
+// (?:-?\d+|0x[A-F0-9]+|ON|OFF|---): Matches a number value, hex value, ON, OFF, or ---.
+// |: Alternation (OR) operator.
+// BMV: Matches the string "BMV".
+// SER#: Matches the string "SER#".
+// [A-Z][A-Za-z0-9/ ]*: Matches a capitalized string value.
+// \r\n: Matches a carriage return.
+//                                    1
+inline const std::regex ve_direct_line_regex(
+    "^(?:"
+        "(?:[A-Z][A-Za-z0-9]*\\t(?:-?[0-9]+|0x[A-F0-9]+|ON|OFF|---))"   // [A-Z][A-Za-z0-9]*: Matches a capitalized name. (?:-?\d+|0x[A-F0-9]+|ON|OFF|---): Matches a number value, hex value, ON, OFF, or ---.
+    "|"
+        "(?:BMV|SER#|FWE)\\t[A-Z0-9][A-Za-z0-9/ ]*"                     // BMV: Matches the string "BMV", "SER#"" or "FWE". [A-Z0-9][A-Za-z0-9/ ]*: Matches a capitalized string value.
+    ")\\r$"                                                             // Note that the \n is not included because reading a line on Linux discards the \n.
+);
+
+// Table driven implementation of the same grammar (the default validator).
+// std::regex is a backtracking engine and is by far the most expensive part of this reader.
+// The DFA below is generated at compile time and needs exactly one table lookup per character.
+// The states track the special names "BMV", "SER#" and "FWE" because these also allow a <capitalized-string-value>.
+// Like the regex, a line is checked without the \n (so it must end with \r).
+enum LineState : unsigned char {
+    LS_REJECT = 0,                                  // Dead state, all transitions lead back to LS_REJECT
+    LS_START,                                       // Start of the line
+    LS_NAME,                                        // Inside a <capitalized-name>
+    LS_B, LS_BM, LS_BMV,                            // Prefixes of "BMV"
+    LS_S, LS_SE, LS_SER, LS_SERH,                   // Prefixes of "SER#"
+    LS_F, LS_FW, LS_FWE,                            // Prefixes of "FWE"
+    LS_VALUE,                                       // After the tab: <number-value>, <hex-value>, "ON", "OFF" or "---"
+    LS_VALUE_OR_STRING,                             // After "BMV\t" or "FWE\t": any value or a <capitalized-string-value>
+    LS_STRING_START,                                // After "SER#\t": only a <capitalized-string-value>
+    LS_MINUS,                                       // "-" (start of a negative number or "---")
+    LS_INT,                                         // Inside a <signed-integer>
+    LS_ZERO,                                        // "0" (start of a number or a hex value)
+    LS_HEX_PREFIX,                                  // "0x"
+    LS_HEX,                                         // Inside a <hex-value>
+    LS_O, LS_ON, LS_OF, LS_OFF,                     // Prefixes of "ON" and "OFF"
+    LS_MINUS2, LS_MINUS3,                           // Prefixes of "---"
+    LS_STRING,                                      // Inside a <capitalized-string-value>
+    LS_CR,                                          // Final \r seen, the line must end here (accepting state)
+    LS_COUNT
+};
+
+using LineDfa = std::array<std::array<unsigned char, 256>, LS_COUNT>;
+
+constexpr LineDfa build_line_dfa() {
+    LineDfa dfa{};  // All transitions default to LS_REJECT
+
+    auto upper = [](int c) { return c >= 'A' && c <= 'Z'; };
+    auto lower = [](int c) { return c >= 'a' && c <= 'z'; };
+    auto digit = [](int c) { return c >= '0' && c <= '9'; };
+    auto hexdigit = [&](int c) { return digit(c) || (c >= 'A' && c <= 'F'); };
+
+    for (int c = 0; c < 256; c++) {
+        bool name_rest = upper(c) || lower(c) || digit(c);
+        bool string_rest = name_rest || c == '/' || c == ' ';
+
+        if (upper(c))
+            dfa[LS_START][c] = LS_NAME;
+        if (name_rest)
+            for (auto s : {LS_NAME, LS_B, LS_BM, LS_BMV, LS_S, LS_SE, LS_SER, LS_F, LS_FW, LS_FWE})
+                dfa[s][c] = LS_NAME;
+
+        if (digit(c))
+            dfa[LS_VALUE][c] = dfa[LS_MINUS][c] = dfa[LS_INT][c] = dfa[LS_ZERO][c] = LS_INT;
+        if (hexdigit(c))
+            dfa[LS_HEX_PREFIX][c] = dfa[LS_HEX][c] = LS_HEX;
+
+        // Every <capitalized-string-value> that starts with [A-Z0-9] is accepted after "BMV\t" and "FWE\t".
+        // Of the other values only the ones starting with "-" are not a valid string as well.
+        if (upper(c) || digit(c))
+            dfa[LS_VALUE_OR_STRING][c] = dfa[LS_STRING_START][c] = LS_STRING;
+        if (string_rest)
+            dfa[LS_STRING][c] = LS_STRING;
+    }
+
+    // The special names
+    dfa[LS_START]['B'] = LS_B;
+    dfa[LS_B]['M'] = LS_BM;
+    dfa[LS_BM]['V'] = LS_BMV;
+    dfa[LS_START]['S'] = LS_S;
+    dfa[LS_S]['E'] = LS_SE;
+    dfa[LS_SE]['R'] = LS_SER;
+    dfa[LS_SER]['#'] = LS_SERH;
+    dfa[LS_START]['F'] = LS_F;
+    dfa[LS_F]['W'] = LS_FW;
+    dfa[LS_FW]['E'] = LS_FWE;
+
+    // The tab between name and value
+    for (auto s : {LS_NAME, LS_B, LS_BM, LS_S, LS_SE, LS_SER, LS_F, LS_FW})
+        dfa[s]['\t'] = LS_VALUE;
+    dfa[LS_BMV]['\t'] = dfa[LS_FWE]['\t'] = LS_VALUE_OR_STRING;
+    dfa[LS_SERH]['\t'] = LS_STRING_START;
+
+    // The values
+    dfa[LS_VALUE]['0'] = LS_ZERO;
+    dfa[LS_ZERO]['x'] = LS_HEX_PREFIX;
+    dfa[LS_VALUE]['-'] = dfa[LS_VALUE_OR_STRING]['-'] = LS_MINUS;
+    dfa[LS_MINUS]['-'] = LS_MINUS2;
+    dfa[LS_MINUS2]['-'] = LS_MINUS3;
+    dfa[LS_VALUE]['O'] = LS_O;
+    dfa[LS_O]['N'] = LS_ON;
+    dfa[LS_O]['F'] = LS_OF;
+    dfa[LS_OF]['F'] = LS_OFF;
+
+    // The end of the line
+    for (auto s : {LS_INT, LS_ZERO, LS_HEX, LS_ON, LS_OFF, LS_MINUS3, LS_STRING})
+        dfa[s]['\r'] = LS_CR;
+
+    return dfa;
+}
+
+inline constexpr LineDfa line_dfa = build_line_dfa();
+
+inline bool line_matches_grammar(std::string_view line) {
+    unsigned char state = LS_START;
+    for (unsigned char c : line) {
+        state = line_dfa[state][c];
+        if (state == LS_REJECT)
+            return false;
+    }
+    return state == LS_CR;
+}
+
+// Select the regex validator instead of the table driven one (--regex-validator)
+inline bool use_regex_validator = false;
+
+inline bool line_is_valid(std::string_view line) {
+    if (use_regex_validator)
+        return std::regex_search(line.begin(), line.end(), ve_direct_line_regex);
+    return line_matches_grammar(line);
+}
+
+// Split off the first line (without the \n) of text, just like std::getline would do
+inline std::string_view next_line(std::string_view &text) {
+    auto eol = text.find('\n');
+    auto line = text.substr(0, eol);
+    text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+    return line;
+}
+
+enum class BlockStatus {
+    Valid,
+    ChecksumError,
+    FormatErrorStart,               // The block doesn't start with \r\n
+    FormatErrorLine,                // A line doesn't meet the grammar
+    FormatErrorFields,              // BlockParser only: more than max_fields fields
+    FormatErrorSize                 // BlockParser only: no block end within max_block_size bytes
+};
+
+struct BlockCheck {
+    BlockStatus status;
+    std::string_view lines;         // Valid: the lines of the block, without the first \r\n and the checksum line
+    std::string_view bad_line;      // FormatErrorLine: the first line that doesn't meet the grammar
+};
+
+// Check one block, from the start of the block up to and including the checksum byte
+inline BlockCheck check_block(std::string_view block) {
+    // Calculate the modulo 256 sum of all the bytes in this block
+    // The used checksum is very weak, e.g. if 2 characters have a bit-7 flip, it cannot be detected.
+    unsigned char sum = 0;
+    for (unsigned char c : block)
+        sum += c;
+
+    if (sum != 0)
+        return {BlockStatus::ChecksumError, {}, {}};
+
+    // Get rid of the checksum line (the checksum identifier and value have no further use)
+    block.remove_suffix(constexpr_strlen("Checksum\t") + 1);
+    // The block now ends with \r\n (this is what we want)
+    // Delete the first \r\n of this block.
+
+    // Check if the first 2 characters are \r\n
+    if (!block.starts_with("\r\n"))
+        return {BlockStatus::FormatErrorStart, {}, {}};
+    block.remove_prefix(2);
+
+    // Extract line by line from the block and check if the line matches the grammar
+    // If there is a grammer error, discard the whole block (we cannot trust anything in this block)
+    for (auto lines = block; !lines.empty();) {
+        auto line = next_line(lines);
+        if (!line_is_valid(line))
+            return {BlockStatus::FormatErrorLine, {}, line};
+    }
+    return {BlockStatus::Valid, block, {}};
+}
+
+// Error recovery (vicread --recover): most checksum errors on a cheap USB adapter are a single flipped bit.
+// The checksum tells which bit: restoring the original byte o from the received byte c must add -sum (mod 256)
+// to the sum, so o - c = +/-2^bit. That leaves one bit and a direction (bit 7 both ways), so about half of
+// the bytes in the block are a candidate. A candidate fits when the block with that bit flipped back also meets
+// the grammar. The block is only recovered when exactly one candidate fits, a flip of one digit into another
+// (which often fits in many places) is never recovered.
+//
+// The candidates are checked incrementally, without running the DFA over the line for every candidate:
+// for every position in a line the DFA state before it (forward pass) and the set of states from which the rest of
+// the line is accepted (backward pass) are known, so a candidate costs one table lookup. Only a candidate that
+// adds or removes a \n changes the lines themselves; these (at most a few per block) get a complete check.
+static_assert(LS_COUNT <= 32, "The sets of DFA states are 32 bit masks");
+
+// The byte at pos of block, with the flipped bit restored
+struct RecoveryCandidate {
+    std::size_t pos;
+    unsigned char original;
+};
+
+// Find the single bit flip that explains a checksum error. Returns true and fills fixed with the repaired block
+// when exactly one candidate makes the block pass check_block().
+inline bool recover_block(std::string_view block, std::string &fixed) {
+    unsigned char sum = 0;
+    for (unsigned char c : block)
+        sum += c;
+    if (sum == 0 || block.size() < constexpr_strlen("\r\nChecksum\t") + 1)
+        return false;
+
+    // The bit that was flipped, and whether it must be set (o - c = +2^bit) or cleared (o - c = -2^bit)
+    unsigned char need = -sum;
+    bool set = (need & (need - 1)) == 0;
+    if (!set && (sum & (sum - 1)) != 0)
+        return false;                   // Not a single bit flip
+    unsigned char bit = set ? need : sum;
+    bool any_direction = bit == 0x80;   // +128 and -128 are the same modulo 256
+    auto restore = [&](unsigned char c, unsigned char &original) {
+        if (!any_direction && ((c & bit) != 0) == set)
+            return false;               // The bit must be restored, so it must have the other value now
+        original = c ^ bit;
+        return true;
+    };
+
+    RecoveryCandidate found{};
+    unsigned candidates = 0;
+    auto candidate_fits = [&](std::size_t pos, unsigned char original) {
+        if (++candidates > 1)
+            return false;               // Ambiguous, stop searching
+        found = {pos, original};
+        return true;
+    };
+
+    // A complete check of the block with one byte restored (for the candidates that change the lines)
+    auto fits_completely = [&](std::size_t pos, unsigned char original) {
+        fixed.assign(block);
+        fixed[pos] = original;
+        return check_block(fixed).status == BlockStatus::Valid;
+    };
+
+    // The checksum line ("Checksum\t" is where the scanner found the block end, only the checksum byte can be wrong)
+    std::size_t body_end = block.size() - constexpr_strlen("Checksum\t") - 1;
+    std::string_view body = block.substr(0, body_end);
+
+    // The first \r\n of the block
+    if (!body.starts_with("\r\n")) {
+        for (std::size_t pos = 0; pos < 2; pos++) {
+            unsigned char original;
+            if (restore(block[pos], original) && fits_completely(pos, original) && !candidate_fits(pos, original))
+                return false;
+        }
+    } else {
+        // The lines, without the \n (the lines that don't meet the grammar limit where the flipped bit can be)
+        std::string_view lines = body.substr(2);
+        unsigned invalid_lines = 0;
+        for (auto rest = lines; !rest.empty();)
+            invalid_lines += !line_matches_grammar(next_line(rest));
+        if (invalid_lines > 2)
+            return false;               // One flipped \n can break 2 lines, one other byte only 1
+
+        std::array<unsigned char, 256> forward;     // forward[i]: the DFA state before line[i]
+        std::array<std::uint32_t, 257> backward;    // backward[i]: the states from which line[i..] is accepted
+        std::size_t line_start = 2;
+        for (auto rest = lines; !rest.empty();) {
+            auto line = next_line(rest);
+            std::size_t newline = line_start + line.size();     // Position of the \n after the line (if any)
+            // A byte that is restored to \n, or a \n restored to something else, changes the lines
+            for (std::size_t pos = line_start; pos <= newline && pos < body_end; pos++) {
+                unsigned char original;
+                if (restore(block[pos], original) && (pos == newline || original == '\n') &&
+                    fits_completely(pos, original) && !candidate_fits(pos, original))
+                    return false;
+            }
+            bool valid = line_matches_grammar(line);
+            if (invalid_lines == 0 || (invalid_lines == 1 && !valid)) {
+                // The flipped bit can be in this line. When the line doesn't fit in forward/backward its candidates
+                // can't be counted, and another candidate could wrongly look like the only one: no recovery.
+                if (line.size() >= forward.size())
+                    return false;
+                unsigned char state = LS_START;
+                for (std::size_t i = 0; i < line.size(); i++) {
+                    forward[i] = state;
+                    state = line_dfa[state][static_cast<unsigned char>(line[i])];
+                }
+                backward[line.size()] = 1u << LS_CR;
+                for (std::size_t i = line.size(); i-- > 0;) {
+                    std::uint32_t from = 0;
+                    for (unsigned s = LS_START; s < LS_COUNT; s++)
+                        from |= ((backward[i + 1] >> line_dfa[s][static_cast<unsigned char>(line[i])]) & 1u) << s;
+                    backward[i] = from;
+                }
+                for (std::size_t i = 0; i < line.size(); i++) {
+                    unsigned char original;
+                    if (restore(line[i], original) && original != '\n' &&
+                        ((backward[i + 1] >> line_dfa[forward[i]][original]) & 1u) != 0 &&
+                        !candidate_fits(line_start + i, original))
+                        return false;
+                }
+            }
+            line_start = newline + 1;
+        }
+
+        // The checksum byte itself, when everything else is fine
+        unsigned char original;
+        if (invalid_lines == 0 && restore(block.back(), original) && !candidate_fits(block.size() - 1, original))
+            return false;
+    }
+
+    if (candidates != 1)
+        return false;
+    fixed.assign(block);
+    fixed[found.pos] = found.original;
+    return check_block(fixed).status == BlockStatus::Valid;
+}
+
+// The VE.Direct field dictionary: the known labels with their type, scale and unit.
+// The index in this table is the field id. Ids are stored in the binary output, so new labels go at the end.
+enum class FieldType : unsigned char {
+    Number,                             // <number-value>, decoded as an integer
+    Hex,                                // <hex-value>, decoded as an integer (e.g. PID, OR)
+    OnOff,                              // "ON" is 1, "OFF" is 0
+    Text                                // Kept as text (e.g. SER#, FW)
+};
+
+struct FieldInfo {
+    std::string_view label;
+    FieldType type;
+    double scale;                       // Multiply the integer value with the scale to get the value in unit
+    std::string_view unit;
+};
+
+inline constexpr FieldInfo field_dictionary[] = {
+    {"V",     FieldType::Number, 0.001, "V"},       // Main or channel 1 (battery) voltage
+    {"V2",    FieldType::Number, 0.001, "V"},       // Channel 2 (battery) voltage
+    {"V3",    FieldType::Number, 0.001, "V"},       // Channel 3 (battery) voltage
+    {"VS",    FieldType::Number, 0.001, "V"},       // Auxiliary (starter) voltage
+    {"VM",    FieldType::Number, 0.001, "V"},       // Mid-point voltage of the battery bank
+    {"DM",    FieldType::Number, 0.1,   "%"},       // Mid-point deviation of the battery bank
+    {"VPV",   FieldType::Number, 0.001, "V"},       // Panel voltage
+    {"PPV",   FieldType::Number, 1.0,   "W"},       // Panel power
+    {"I",     FieldType::Number, 0.001, "A"},       // Main or channel 1 battery current
+    {"I2",    FieldType::Number, 0.001, "A"},       // Channel 2 battery current
+    {"I3",    FieldType::Number, 0.001, "A"},       // Channel 3 battery current
+    {"IL",    FieldType::Number, 0.001, "A"},       // Load current
+    {"LOAD",  FieldType::OnOff,  1.0,   ""},        // Load output state
+    {"T",     FieldType::Number, 1.0,   "°C"},      // Battery temperature
+    {"P",     FieldType::Number, 1.0,   "W"},       // Instantaneous power
+    {"CE",    FieldType::Number, 0.001, "Ah"},      // Consumed Amp Hours
+    {"SOC",   FieldType::Number, 0.1,   "%"},       // State-of-charge
+    {"TTG",   FieldType::Number, 1.0,   "min"},     // Time-to-go
+    {"Alarm", FieldType::OnOff,  1.0,   ""},        // Alarm condition active
+    {"Relay", FieldType::OnOff,  1.0,   ""},        // Relay state
+    {"AR",    FieldType::Number, 1.0,   ""},        // Alarm reason
+    {"OR",    FieldType::Hex,    1.0,   ""},        // Off reason
+    {"H1",    FieldType::Number, 0.001, "Ah"},      // Depth of the deepest discharge
+    {"H2",    FieldType::Number, 0.001, "Ah"},      // Depth of the last discharge
+    {"H3",    FieldType::Number, 0.001, "Ah"},      // Depth of the average discharge
+    {"H4",    FieldType::Number, 1.0,   ""},        // Number of charge cycles
+    {"H5",    FieldType::Number, 1.0,   ""},        // Number of full discharges
+    {"H6",    FieldType::Number, 0.001, "Ah"},      // Cumulative Amp Hours drawn
+    {"H7",    FieldType::Number, 0.001, "V"},       // Minimum main (battery) voltage
+    {"H8",    FieldType::Number, 0.001, "V"},       // Maximum main (battery) voltage
+    {"H9",    FieldType::Number, 1.0,   "s"},       // Number of seconds since last full charge
+    {"H10",   FieldType::Number, 1.0,   ""},        // Number of automatic synchronizations
+    {"H11",   FieldType::Number, 1.0,   ""},        // Number of low main voltage alarms
+    {"H12",   FieldType::Number, 1.0,   ""},        // Number of high main voltage alarms
+    {"H13",   FieldType::Number, 1.0,   ""},        // Number of low auxiliary voltage alarms
+    {"H14",   FieldType::Number, 1.0,   ""},        // Number of high auxiliary voltage alarms
+    {"H15",   FieldType::Number, 0.001, "V"},       // Minimum auxiliary (battery) voltage
+    {"H16",   FieldType::Number, 0.001, "V"},       // Maximum auxiliary (battery) voltage
+    {"H17",   FieldType::Number, 0.01,  "kWh"},     // Amount of discharged energy
+    {"H18",   FieldType::Number, 0.01,  "kWh"},     // Amount of charged energy
+    {"H19",   FieldType::Number, 0.01,  "kWh"},     // Yield total (user resettable counter)
+    {"H20",   FieldType::Number, 0.01,  "kWh"},     // Yield today
+    {"H21",   FieldType::Number, 1.0,   "W"},       // Maximum power today
+    {"H22",   FieldType::Number, 0.01,  "kWh"},     // Yield yesterday
+    {"H23",   FieldType::Number, 1.0,   "W"},       // Maximum power yesterday
+    {"ERR",   FieldType::Number, 1.0,   ""},        // Error code
+    {"CS",    FieldType::Number, 1.0,   ""},        // State of operation
+    {"BMV",   FieldType::Text,   1.0,   ""},        // Model description (deprecated)
+    {"FW",    FieldType::Text,   1.0,   ""},        // Firmware version (16 bit)
+    {"FWE",   FieldType::Text,   1.0,   ""},        // Firmware version (24 bit)
+    {"PID",   FieldType::Hex,    1.0,   ""},        // Product ID
+    {"SER#",  FieldType::Text,   1.0,   ""},        // Serial number
+    {"HSDS",  FieldType::Number, 1.0,   ""},        // Day sequence number (0..364)
+    {"MODE",  FieldType::Number, 1.0,   ""},        // Device mode
+    {"WARN",  FieldType::Number, 1.0,   ""},        // Warning reason
+    {"MPPT",  FieldType::Number, 1.0,   ""},        // Tracker operation mode
+    {"MON",   FieldType::Number, 1.0,   ""},        // DC monitor mode
+};
+
+inline constexpr int field_count = std::size(field_dictionary);
+inline constexpr int unknown_field = -1;
+
+// Compile-time perfect hash of the labels: a seeded FNV-1a hash, with the seed searched by the compiler
+// such that every label has its own slot. A lookup is one hash, one table read and one compare.
+constexpr std::uint32_t label_hash(std::string_view label, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+    for (unsigned char c : label)
+        h = (h ^ c) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+inline constexpr std::size_t label_slots = 256;     // Power of 2, a few times the number of labels so a seed is found quickly
+
+struct LabelHashTable {
+    std::uint32_t seed = 0;
+    std::array<signed char, label_slots> slots{};
+};
+
+constexpr LabelHashTable build_label_hash_table() {
+    static_assert(field_count < 128 && label_slots >= 4 * field_count);
+    for (std::uint32_t seed = 0;; seed++) {
+        LabelHashTable table;
+        table.seed = seed;
+        table.slots.fill(unknown_field);
+        bool collision = false;
+        for (int id = 0; id < field_count && !collision; id++) {
+            auto &slot = table.slots[label_hash(field_dictionary[id].label, seed) & (label_slots - 1)];
+            collision = slot != unknown_field;
+            slot = id;
+        }
+        if (!collision)
+            return table;
+    }
+}
+
+inline constexpr LabelHashTable label_hash_table = build_label_hash_table();
+
+// Returns the field id of a label, or unknown_field
+constexpr int lookup_field(std::string_view label) {
+    int id = label_hash_table.slots[label_hash(label, label_hash_table.seed) & (label_slots - 1)];
+    return id != unknown_field && field_dictionary[id].label == label ? id : unknown_field;
+}
+
+static_assert(lookup_field("SER#") != unknown_field && lookup_field("H23") != unknown_field && lookup_field("Checksum") == unknown_field);
+
+// One field of a valid block: views into the received data plus the decoded value
+struct Field {
+    int id;                             // Field id or unknown_field
+    std::string_view name;
+    std::string_view value;
+    bool numeric;                       // The value is decoded into number (otherwise use the text)
+    std::int64_t number;
+};
+
+// Decode a value according to the field type, without any allocation.
+// Unknown labels, text fields, "---" and values that don't fit in 64 bits are kept as text.
+inline bool decode_value(int id, std::string_view value, std::int64_t &number) {
+    if (id == unknown_field)
+        return false;
+    const char *first = value.data();
+    const char *last = first + value.size();
+    std::from_chars_result res;
+    switch (field_dictionary[id].type) {
+    case FieldType::Number:
+        res = std::from_chars(first, last, number);
+        return res.ec == std::errc() && res.ptr == last;
+    case FieldType::Hex: {
+        if (!value.starts_with("0x"))
+            return false;
+        std::uint64_t u = 0;
+        res = std::from_chars(first + 2, last, u, 16);
+        number = static_cast<std::int64_t>(u);
+        return res.ec == std::errc() && res.ptr == last;
+    }
+    case FieldType::OnOff:
+        number = value == "ON";
+        return value == "ON" || value == "OFF";
+    case FieldType::Text:
+        return false;
+    }
+    return false;
+}
+
+// The fields of one block. A VE.Direct block has at most 22 fields (spec), so this leaves plenty of room.
+inline constexpr std::size_t max_fields = 64;
+
+struct Fields {
+    std::size_t count = 0;
+    std::array<Field, max_fields> items;
+
+    auto begin() const { return items.begin(); }
+    auto end() const { return items.begin() + count; }
+};
+
+// Split the lines of a valid block (see check_block) in fields and decode them. Returns false if there are too many fields.
+inline bool decode_fields(std::string_view lines, Fields &fields) {
+    fields.count = 0;
+    while (!lines.empty()) {
+        auto line = next_line(lines);
+        if (fields.count == max_fields)
+            return false;
+        line.remove_suffix(1);          // The \r at the end
+        auto tab_pos = line.find('\t');
+        auto &field = fields.items[fields.count++];
+        field.name = line.substr(0, tab_pos);
+        field.value = line.substr(tab_pos + 1);
+        field.id = lookup_field(field.name);
+        field.numeric = decode_value(field.id, field.value, field.number);
+    }
+    return true;
+}
+
+// White list filter: a bit per known field id, plus a (normally empty) list of unknown labels
+struct FieldFilter {
+    bool all = true;                    // No white list filter
+    std::bitset<field_count> known;
+    std::vector<std::string> unknown;
+    std::string names;                  // Comma separated, for messages
+
+    bool accepts(const Field &field) const {
+        if (all)
+            return true;
+        if (field.id != unknown_field)
+            return known.test(field.id);
+        return std::find(unknown.begin(), unknown.end(), field.name) != unknown.end();
+    }
+
+    void add(std::string_view name) {
+        if (!all)
+            names += ',';
+        names += name;
+        all = false;
+        int id = lookup_field(name);
+        if (id != unknown_field)
+            known.set(id);
+        else
+            unknown.emplace_back(name);
+    }
+};
+
+// Deadband of a field for the change-only output, in the units of the protocol (e.g. mV, W, 0.1%)
+struct Deadband {
+    std::int64_t absolute = 0;          // Changes up to this value are not sent
+    double relative = 0.0;              // Changes up to this fraction of the last sent value are not sent
+};
+
+using Deadbands = std::array<Deadband, field_count>;
+
+// Change-only output: the last sent value of every field of one device.
+// Values are compared with the last *sent* value, so slow drifts within the deadband still get through.
+class ChangeFilter {
+public:
+    // Returns true if the field must be sent: the first time, when it changed more than its deadband,
+    // or on a keyframe. The deadband only applies to numbers, any change of other fields is sent.
+    bool changed(const Field &field, const Deadbands &deadbands, bool keyframe) {
+        if (field.id == unknown_field)
+            return changed_unknown(field, keyframe);
+
+        LastValue &last = known_[field.id];
+        bool send = keyframe || !last.valid || last.numeric != field.numeric;
+        if (!send && field.numeric) {
+            auto const &band = deadbands[field.id];
+            std::int64_t diff = field.number > last.number ? field.number - last.number : last.number - field.number;
+            if (field_dictionary[field.id].type == FieldType::Number)
+                send = diff > band.absolute && diff > band.relative * (last.number < 0 ? -last.number : last.number);
+            else
+                send = diff != 0;
+        } else if (!send) {
+            send = field.value != last.text;
+        }
+        if (send) {
+            last.valid = true;
+            last.numeric = field.numeric;
+            last.number = field.number;
+            if (!field.numeric)
+                last.text = field.value;
+        }
+        return send;
+    }
+
+private:
+    struct LastValue {
+        bool valid = false;
+        bool numeric = false;
+        std::int64_t number = 0;
+        std::string text;
+    };
+
+    bool changed_unknown(const Field &field, bool keyframe) {
+        auto it = std::find_if(unknown_.begin(), unknown_.end(), [&field](auto const &entry) { return entry.first == field.name; });
+        if (it == unknown_.end()) {
+            unknown_.emplace_back(field.name, field.value);
+            return true;
+        }
+        if (!keyframe && it->second == field.value)
+            return false;
+        it->second = field.value;
+        return true;
+    }
+
+    std::array<LastValue, field_count> known_;
+    std::vector<std::pair<std::string, std::string>> unknown_;      // Labels that are not in the dictionary
+};
+
+// Incremental statistics of one field over a window. Fixed size, whatever the length of the window.
+struct Accumulator {
+    std::uint32_t count = 0;
+    std::int64_t sum = 0;
+    std::int64_t min = 0;
+    std::int64_t max = 0;
+    std::int64_t last = 0;
+
+    void add(std::int64_t value) {
+        min = count == 0 ? value : std::min(min, value);
+        max = count == 0 ? value : std::max(max, value);
+        count++;
+        sum += value;
+        last = value;
+    }
+
+    double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+};
+
+// Windowed aggregation (--aggregate) of the number fields of one device, plus the energy integrated from P (W)
+class Aggregator {
+public:
+    std::int64_t start_ns = 0;          // Wall-clock time of the window
+    std::int64_t end_ns = 0;
+    std::bitset<field_count> present;   // Fields with at least 1 value in this window
+    std::array<Accumulator, field_count> fields;
+    bool has_energy = false;
+    double energy_ws = 0.0;             // Watt-seconds
+
+    // Start a new window. The last P sample is kept, so the energy integration continues seamlessly.
+    void reset(std::int64_t start, std::int64_t end) {
+        start_ns = start;
+        end_ns = end;
+        present.reset();
+        has_energy = false;
+        energy_ws = 0.0;
+    }
+
+    bool empty() const { return present.none() && !has_energy; }
+
+    std::int64_t energy_mwh() const { return static_cast<std::int64_t>(energy_ws / 3.6 + (energy_ws < 0 ? -0.5 : 0.5)); }
+
+    // Add the number fields for which accept(field) is true, from a block received at monotonic time now_ns
+    template <typename Accept>
+    void add(const Fields &block, Accept &&accept, std::int64_t now_ns) {
+        for (auto const &field : block) {
+            if (!field.numeric || field_dictionary[field.id].type != FieldType::Number || !accept(field))
+                continue;
+            if (!present.test(field.id)) {
+                present.set(field.id);
+                fields[field.id] = Accumulator{};
+            }
+            fields[field.id].add(field.number);
+            if (field.id == power_field)
+                integrate_power(field.number, now_ns);
+        }
+    }
+
+private:
+    static constexpr int power_field = lookup_field("P");
+    static constexpr std::int64_t max_power_gap_ns = 10'000'000'000;   // Longer gaps (e.g. a disconnect) are not integrated
+
+    // Trapezoidal integration between successive P samples
+    void integrate_power(std::int64_t power, std::int64_t now_ns) {
+        if (have_power_ && now_ns - last_power_ns_ <= max_power_gap_ns)
+            energy_ws += 0.5 * static_cast<double>(power + last_power_) * (now_ns - last_power_ns_) / 1e9;
+        has_energy = true;
+        have_power_ = true;
+        last_power_ = power;
+        last_power_ns_ = now_ns;
+    }
+
+    bool have_power_ = false;
+    std::int64_t last_power_ = 0;
+    std::int64_t last_power_ns_ = 0;
+};
+
+// Hand the summary of a window to on_line(name, suffix, value) as text lines, e.g. ("V", "_mean", "27001.25").
+// The fields come in dictionary order, followed by the energy ("P", "_mWh") when P was received.
+template <typename LineHandler>
+void for_each_summary_line(const Aggregator &window, LineHandler &&on_line) {
+    char buf[32];
+    auto number = [&buf](std::int64_t value) {
+        auto res = std::to_chars(buf, buf + sizeof(buf), value);
+        return std::string_view(buf, res.ptr - buf);
+    };
+    for (int id = 0; id < field_count; id++) {
+        if (!window.present.test(id))
+            continue;
+        auto const &acc = window.fields[id];
+        std::string_view label = field_dictionary[id].label;
+        on_line(label, "_count", number(acc.count));
+        auto res = std::to_chars(buf, buf + sizeof(buf), acc.mean(), std::chars_format::fixed, 2);
+        on_line(label, "_mean", std::string_view(buf, res.ptr - buf));
+        on_line(label, "_min", number(acc.min));
+        on_line(label, "_max", number(acc.max));
+        on_line(label, "_last", number(acc.last));
+    }
+    if (window.has_energy)
+        on_line("P", "_mWh", number(window.energy_mwh()));
+}
+
+// Single pass block parser, fed with the bytes as they are read (vicread).
+// Every byte is handled once: it is added to the checksum, checked for the end of the block ("Checksum\t" and one
+// byte), for the start of a HEX-message and against the grammar (line_dfa), and the line boundaries and the tab
+// give the name and value of every field as soon as its line ends. So when the checksum byte arrives the block is
+// already validated and split into decoded fields. The result is the same as check_block() + decode_fields() on the
+// whole block, in the same order of checks: the checksum first, then the start and then the lines.
+//
+// HEX-messages go to a separate buffer, the bytes of a block around them stay where they are. After the first line
+// that doesn't meet the grammar the rest of the block is no longer stored, only summed, so the status (checksum
+// or format error) is still known at the block end, and the parser is in sync with the next block. With
+// keep_errors() the whole block is stored anyway, for recover_block().
+inline constexpr std::size_t max_block_size = 64 * 1024;   // A block is at most a few hundred bytes, this leaves plenty of room for garbage
+inline constexpr std::size_t max_hex_message_size = 512;    // Longer HEX-messages are cut off (and fail their checksum)
+
+// The DFA of the fast path of BlockParser: line_dfa, but a tab after a name is handled by the slow path as well
+// (it can be the tab of "Checksum\t"). So is every transition to LS_REJECT, which includes \n and ':'.
+constexpr LineDfa build_parser_dfa() {
+    LineDfa dfa = build_line_dfa();
+    for (auto s : {LS_NAME, LS_B, LS_BM, LS_BMV, LS_S, LS_SE, LS_SER, LS_SERH, LS_F, LS_FW, LS_FWE})
+        dfa[s]['\t'] = LS_REJECT;
+    return dfa;
+}
+
+inline constexpr LineDfa parser_dfa = build_parser_dfa();
+
+// One block found by BlockParser. The views are valid during the call of the block handler only.
+struct ParsedBlock {
+    BlockStatus status;
+    std::size_t size;                   // Bytes in the block, without the HEX-messages in it
+    std::string_view text;              // The stored bytes of the block
+    bool complete;                      // text is the whole block (always for a valid block, see keep_errors())
+    std::string_view bad_line;          // FormatErrorLine: the first line that doesn't meet the grammar
+    const Fields &fields;               // Valid: the fields of the block, decoded
+};
+
+class BlockParser {
+public:
+    BlockParser() : buf_(std::make_unique<char[]>(max_block_size)) {}
+    BlockParser(const BlockParser &) = delete;
+    BlockParser &operator=(const BlockParser &) = delete;
+
+    // Store a block with a bad line completely, not only up to that line (needed by recover_block())
+    void keep_errors(bool keep) { keep_errors_ = keep; }
+
+    // Bytes of the current incomplete block and HEX-message
+    std::size_t pending() const { return size_ + hex_size_ + colon_; }
+
+    // Throw away the incomplete block (e.g. the device was disconnected)
+    void reset() {
+        start_block();
+        hex_ = colon_ = false;
+        hex_size_ = 0;
+    }
+
+    // Parse the bytes. Every complete block is handed to on_block(const ParsedBlock &), every HEX-message
+    // (including the newline) to on_hex(std::string_view).
+    template <typename BlockHandler, typename HexHandler>
+    void feed(const char *data, std::size_t size, BlockHandler &&on_block, HexHandler &&on_hex) {
+        const char *end = data + size;
+        while (data < end) {
+            if (start_ == 2 && !line_error_ && !checksum_byte_ && !hex_ && !colon_ && !use_regex_validator) {
+                // Inside the lines of a block: the fast path. Most bytes only go through the DFA, the end of a line
+                // and the tab are handled here too. The state is kept in local variables, because the stores into
+                // the buffer (char) could alias the members.
+                unsigned char sum = sum_;
+                unsigned char state = state_;
+                char *buf = buf_.get();
+                std::size_t stored = stored_;
+                std::size_t line_start = line_start_;
+                std::size_t tab = tab_;
+                const char *stop = data + std::min<std::size_t>(end - data, max_block_size - 1 - size_);
+                for (; data < stop; data++) {
+                    auto c = static_cast<unsigned char>(*data);
+                    auto next = parser_dfa[state][c];
+                    if (next == LS_REJECT) {
+                        if (c == '\n' && state == LS_CR) {
+                            add_field(line_start, tab, stored);
+                            line_start = stored + 1;
+                            tab = 0;
+                            next = LS_START;
+                        } else if (c == '\t' && line_dfa[state][c] != LS_REJECT &&
+                                   !std::string_view(buf, stored).ends_with(checksum_label.substr(0, 8))) {
+                            tab = stored;
+                            next = line_dfa[state][c];
+                        } else {
+                            break;      // A byte that doesn't fit, ':' or the tab of "Checksum\t"
+                        }
+                    }
+                    state = next;
+                    sum += c;
+                    buf[stored++] = c;
+                }
+                size_ += stored - stored_;
+                stored_ = stored;
+                sum_ = sum;
+                state_ = state;
+                line_start_ = line_start;
+                tab_ = tab;
+                if (data == end)
+                    break;
+                matched_ = suffix_match(*data);
+            }
+            step(*data++, on_block, on_hex);
+        }
+    }
+
+    template <typename BlockHandler>
+    void feed(const char *data, std::size_t size, BlockHandler &&on_block) {
+        feed(data, size, on_block, [](std::string_view) {});
+    }
+
+private:
+    static constexpr std::string_view checksum_label = "Checksum\t";
+
+    // One byte, the slow path: HEX-messages, the start and the end of a block, the end of a line and bad lines
+    template <typename BlockHandler, typename HexHandler>
+    void step(char c, BlockHandler &&on_block, HexHandler &&on_hex) {
+        if (hex_) {
+            // From: VE.Direct-Protocol-3.32.pdf
+            // " Some products will send Asynchronous HEX-messages, starting with “:A” and ending with a
+            //   newline ‘\n’, on their own. These messages can interrupt a regular Text-mode frame. "
+            if (hex_size_ < max_hex_message_size)
+                hex_buf_[hex_size_++] = c;
+            if (c == '\n') {
+                on_hex(std::string_view(hex_buf_.data(), hex_size_));
+                hex_ = false;
+                hex_size_ = 0;
+            }
+            return;
+        }
+        if (colon_) {
+            // The replies to HEX commands (vicread --poll) look the same, with another response code after the ':'.
+            // A checksum byte ':' is followed by the \r\n of the next block or by a HEX-message, never by a hex digit.
+            colon_ = false;
+            if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F')) {
+                hex_ = true;
+                hex_buf_[0] = ':';
+                hex_buf_[1] = c;
+                hex_size_ = 2;
+                return;
+            }
+            add(':', on_block);
+        }
+        if (c == ':')
+            colon_ = true;          // Wait for the next byte
+        else
+            add(c, on_block);
+    }
+
+    // For the matcher of "Checksum\t" after the fast path: the length of the part of the label in front of c at the end
+    // of the stored bytes (all characters of the label are different)
+    std::size_t suffix_match(char c) const {
+        auto k = checksum_label.find(c);
+        if (k == std::string_view::npos || k == 0 || k > stored_)
+            return 0;
+        return std::string_view(buf_.get() + stored_ - k, k) == checksum_label.substr(0, k) ? k : 0;
+    }
+
+    void start_block() {
+        size_ = stored_ = 0;
+        store_ = true;
+        sum_ = 0;
+        matched_ = 0;
+        checksum_byte_ = false;
+        start_ = 0;
+        line_start_ = 2;
+        tab_ = 0;
+        state_ = LS_START;
+        line_error_ = false;
+        bad_start_ = bad_end_ = 0;
+        fields_.count = 0;
+        too_many_fields_ = false;
+    }
+
+    // One byte of a block
+    template <typename BlockHandler>
+    void add(char c, BlockHandler &&on_block) {
+        sum_ += static_cast<unsigned char>(c);
+        size_++;
+        if (store_)
+            buf_[stored_++] = c;
+        if (checksum_byte_) {
+            end_block(on_block);
+            return;
+        }
+        if (size_ == max_block_size) {
+            on_block(ParsedBlock{BlockStatus::FormatErrorSize, size_, std::string_view(buf_.get(), stored_), stored_ == size_, {}, fields_});
+            start_block();
+            return;
+        }
+        // The end of the block: "Checksum\t" and the byte after it
+        matched_ = c == checksum_label[matched_] ? matched_ + 1 : c == checksum_label[0];
+        if (matched_ == checksum_label.size()) {
+            checksum_byte_ = true;
+            return;
+        }
+        if (start_ < 2) {
+            if (c == "\r\n"[start_]) {
+                start_++;
+            } else {
+                start_ = 3;     // Not \r\n, the lines aren't checked
+                store_ = keep_errors_;
+            }
+            return;
+        }
+        if (start_ > 2)
+            return;
+        if (line_error_) {
+            if (c == '\n' && bad_end_ == 0)
+                end_bad_line();
+            return;
+        }
+        if (c != '\n') {
+            if (c == '\t' && tab_ == 0)
+                tab_ = stored_ - 1;
+            state_ = line_dfa[state_][static_cast<unsigned char>(c)];
+            if (state_ == LS_REJECT && !use_regex_validator) {
+                line_error_ = true;     // Abort the block, the rest of the line is only stored for the error message
+                bad_start_ = line_start_;
+            }
+            return;
+        }
+        // The end of a line, without the \n
+        std::string_view line(buf_.get() + line_start_, stored_ - 1 - line_start_);
+        if (use_regex_validator ? !line_is_valid(line) : state_ != LS_CR) {
+            line_error_ = true;
+            bad_start_ = line_start_;
+            end_bad_line();
+            return;
+        }
+        add_field(line_start_, tab_, stored_ - 1);
+        line_start_ = stored_;
+        tab_ = 0;
+        state_ = LS_START;
+    }
+
+    // A valid line: the name from line_start up to the tab, the value after it up to the \r in front of line_end
+    void add_field(std::size_t line_start, std::size_t tab, std::size_t line_end) {
+        if (fields_.count == max_fields) {
+            too_many_fields_ = true;
+            return;
+        }
+        auto &field = fields_.items[fields_.count++];
+        field.name = std::string_view(buf_.get() + line_start, tab - line_start);
+        field.value = std::string_view(buf_.get() + tab + 1, line_end - 1 - (tab + 1));
+        field.id = lookup_field(field.name);
+        field.numeric = decode_value(field.id, field.value, field.number);
+    }
+
+    // The bad line is complete, the rest of the block is only summed
+    void end_bad_line() {
+        bad_end_ = stored_ - 1;
+        store_ = keep_errors_;
+    }
+
+    template <typename BlockHandler>
+    void end_block(BlockHandler &&on_block) {
+        // The "Checksum" label doesn't have to start a line. Like check_block() does, the text in front of it is then
+        // the last line of the block (without a \n).
+        std::size_t label_start = stored_ - 1 - checksum_label.size();
+        if (start_ == 2 && line_start_ != label_start && (!line_error_ || bad_end_ == 0)) {
+            std::string_view line(buf_.get() + line_start_, label_start - line_start_);
+            line_error_ = !line_is_valid(line);
+            if (line_error_)
+                bad_start_ = line_start_;
+            else
+                add_field(line_start_, tab_, label_start);
+        }
+        if (line_error_ && bad_end_ == 0)
+            bad_end_ = label_start;
+
+        BlockStatus status = BlockStatus::Valid;
+        if (sum_ != 0)
+            status = BlockStatus::ChecksumError;
+        else if (start_ != 2)
+            status = BlockStatus::FormatErrorStart;
+        else if (line_error_)
+            status = BlockStatus::FormatErrorLine;
+        else if (too_many_fields_)
+            status = BlockStatus::FormatErrorFields;
+        std::string_view bad;
+        if (status == BlockStatus::FormatErrorLine)
+            bad = std::string_view(buf_.get() + bad_start_, bad_end_ - bad_start_);
+        on_block(ParsedBlock{status, size_, std::string_view(buf_.get(), stored_), stored_ == size_, bad, fields_});
+        start_block();
+    }
+
+    std::unique_ptr<char[]> buf_;       // The current block
+    std::size_t size_ = 0;              // Bytes in the current block
+    std::size_t stored_ = 0;            // Of these, stored in buf_
+    bool store_ = true;
+    bool keep_errors_ = false;
+    unsigned char sum_ = 0;
+    std::size_t matched_ = 0;           // Bytes of "Checksum\t" matched so far
+    bool checksum_byte_ = false;        // The next byte is the checksum byte, the last of the block
+    unsigned start_ = 0;                // Bytes of the \r\n at the start of the block seen, 3 for a bad start
+    std::size_t line_start_ = 2;        // Offset of the current line in buf_
+    std::size_t tab_ = 0;               // Offset of the tab in the current line, 0 before the tab
+    unsigned char state_ = LS_START;    // line_dfa state of the current line
+    bool line_error_ = false;           // A line doesn't meet the grammar
+    std::size_t bad_start_ = 0;         // Offset of the bad line in buf_
+    std::size_t bad_end_ = 0;           // Offset of its end (without the \n), 0 until it has ended
+    Fields fields_;
+    bool too_many_fields_ = false;
+
+    bool hex_ = false;                  // Inside a HEX-message
+    bool colon_ = false;                // The last byte was a ':', a HEX-message starts when a hex digit follows
+    std::size_t hex_size_ = 0;
+    std::array<char, max_hex_message_size> hex_buf_;
+};
+
+#endif // VEDIRECT_H
@@ -0,0 +1,258 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Synthetic VE.Direct stream generator for the benchmark and for testing.
+// It produces realistic text frames for an MPPT, a SmartShunt and a BMV, with correct checksums.
+// Optionally it interleaves asynchronous HEX-messages and injects bit errors, including the 2 bit-7 flips
+// in one block that the checksum cannot detect.
+
+#ifndef VEGEN_H
+#define VEGEN_H
+
+// C++ header files
+#include <string>
+#include <string_view>
+#include <random>
+#include <charconv>
+#include <algorithm>
+
+// C header files
+#include <cstdint>
+
+enum class Profile {
+    Mppt,                               // SmartSolar MPPT, 1 block per second
+    SmartShunt,                         // SmartShunt, main block and history block (H1..H18) alternating
+    Bmv                                 // BMV-712, like the SmartShunt plus the "BMV" model name
+};
+
+struct GeneratorConfig {
+    Profile profile = Profile::Bmv;
+    double hex_rate = 0.0;              // Probability per block that an asynchronous HEX-message is inserted in it
+    double bit_error_rate = 0.0;        // Probability per byte of a single bit flip
+    double msb_flip_rate = 0.0;         // Probability per block of 2 bit-7 flips (the checksum cannot detect these)
+    unsigned seed = 1;
+};
+
+enum class Corruption {
+    None,
+    BitErrors,
+    MsbDoubleFlip
+};
+
+// Append an asynchronous HEX-message, e.g. ":A8DED00E80ADF\n" (register 0xED8D, flags 0x00, value 0x0AE8, checksum 0xDF)
+// The sum of the command nibble and all bytes (including the checksum) is 0x55. Values are little endian.
+inline void append_hex_message(std::string &out, char command, std::uint16_t reg, std::uint8_t flags, std::uint32_t value, int value_size) {
+    static constexpr char hexdigits[] = "0123456789ABCDEF";
+    std::uint8_t bytes[8];
+    int n = 0;
+    bytes[n++] = reg & 0xFF;
+    bytes[n++] = reg >> 8;
+    bytes[n++] = flags;
+    for (int i = 0; i < value_size; i++)
+        bytes[n++] = (value >> (8 * i)) & 0xFF;
+    std::uint8_t sum = command <= '9' ? command - '0' : command - 'A' + 10;
+    for (int i = 0; i < n; i++)
+        sum += bytes[i];
+    bytes[n++] = 0x55 - sum;
+
+    out += ':';
+    out += command;
+    for (int i = 0; i < n; i++) {
+        out += hexdigits[bytes[i] >> 4];
+        out += hexdigits[bytes[i] & 0x0F];
+    }
+    out += '\n';
+}
+
+class Generator {
+public:
+    explicit Generator(GeneratorConfig config) : config_(config), rng_(config.seed) {}
+
+    // Append the next block to out and return the kind of corruption that was injected.
+    // If clean is not null, the block as it should have been received (no HEX-message, no corruption) is stored in it.
+    Corruption next_block(std::string &out, std::string *clean = nullptr) {
+        block_.clear();
+        update();
+        switch (config_.profile) {
+        case Profile::Mppt:
+            mppt_block();
+            break;
+        case Profile::SmartShunt:
+        case Profile::Bmv:
+            if (history_next_)
+                history_block();
+            else
+                battery_monitor_block();
+            history_next_ = !history_next_;
+            break;
+        }
+        // The checksum byte makes the modulo 256 sum of the whole block 0
+        block_ += "\r\nChecksum\t";
+        unsigned char sum = 0;
+        for (unsigned char c : block_)
+            sum += c;
+        block_ += static_cast<char>(-sum);
+        if (clean != nullptr)
+            *clean = block_;
+
+        Corruption corruption = Corruption::None;
+        if (config_.bit_error_rate > 0.0) {
+            // Skip ahead to the next byte with a bit error instead of rolling the dice for every byte
+            std::geometric_distribution<std::size_t> gap(config_.bit_error_rate);
+            for (std::size_t pos = gap(rng_); pos < block_.size(); pos += 1 + gap(rng_)) {
+                block_[pos] ^= static_cast<char>(1 << random(0, 7));
+                corruption = Corruption::BitErrors;
+            }
+        }
+        if (config_.msb_flip_rate > 0.0 && chance(config_.msb_flip_rate)) {
+            std::size_t a = random(0, block_.size() - 1);
+            std::size_t b = random(0, block_.size() - 2);
+            if (b >= a)
+                b++;            // Two different bytes
+            block_[a] ^= '\x80';
+            block_[b] ^= '\x80';
+            corruption = Corruption::MsbDoubleFlip;
+        }
+
+        if (config_.hex_rate > 0.0 && chance(config_.hex_rate)) {
+            // A HEX-message can interrupt a text frame anywhere
+            std::size_t pos = random(0, block_.size());
+            out.append(block_, 0, pos);
+            append_hex_message(out, 'A', 0xED8D, 0x00, voltage_ / 10, 2);     // Battery voltage in 0.01 V
+            out.append(block_, pos);
+        } else {
+            out += block_;
+        }
+        return corruption;
+    }
+
+    // The current values, e.g. for the HEX registers of an emulated device (vicemu)
+    long voltage() const { return voltage_; }               // mV
+    long current() const { return current_; }               // mA
+    long power() const { return power_; }                   // W
+    long soc() const { return soc_; }                       // Per mille
+    long consumed() const { return consumed_; }             // mAh
+    long panel_voltage() const { return panel_voltage_; }   // mV
+    long panel_power() const { return panel_power_; }       // W
+
+private:
+    std::size_t random(std::size_t lo, std::size_t hi) { return std::uniform_int_distribution<std::size_t>(lo, hi)(rng_); }
+    bool chance(double p) { return std::bernoulli_distribution(p)(rng_); }
+
+    // Random walk of the measured values
+    void update() {
+        auto walk = [this](long &value, long step, long lo, long hi) {
+            value = std::clamp(value + std::uniform_int_distribution<long>(-step, step)(rng_), lo, hi);
+        };
+        walk(voltage_, 20, 23000, 29000);
+        walk(current_, 500, -60000, 60000);
+        walk(panel_voltage_, 200, 0, 150000);
+        walk(soc_, 1, 0, 1000);
+        consumed_ = std::min(0L, consumed_ + current_ / 3600);
+        power_ = voltage_ * current_ / 1000000;
+        panel_power_ = std::max(0L, voltage_ * std::max(0L, current_) / 1000000);
+    }
+
+    void field(std::string_view name, std::string_view value) {
+        block_ += "\r\n";
+        block_ += name;
+        block_ += '\t';
+        block_ += value;
+    }
+
+    void field(std::string_view name, long value) {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value);
+        field(name, std::string_view(buf, res.ptr - buf));
+    }
+
+    void mppt_block() {
+        field("PID", "0xA060");
+        field("FW", "159");
+        field("SER#", "HQ2132ABCDE");
+        field("V", voltage_);
+        field("I", std::max(0L, current_) / 10 * 10);
+        field("VPV", panel_voltage_);
+        field("PPV", panel_power_);
+        field("CS", panel_power_ > 0 ? "3" : "0");
+        field("MPPT", panel_power_ > 0 ? "2" : "0");
+        field("OR", "0x00000000");
+        field("ERR", "0");
+        field("LOAD", "ON");
+        field("IL", 300);
+        field("H19", 10230);
+        field("H20", 120);
+        field("H21", 450);
+        field("H22", 98);
+        field("H23", 300);
+        field("HSDS", 123);
+    }
+
+    void battery_monitor_block() {
+        field("PID", config_.profile == Profile::Bmv ? "0xA381" : "0xA389");
+        field("V", voltage_);
+        if (config_.profile == Profile::Bmv)
+            field("VS", 12950);
+        field("I", current_);
+        field("P", power_);
+        field("CE", consumed_);
+        field("SOC", soc_);
+        field("TTG", current_ < 0 ? std::to_string(soc_ * 6) : std::string("---"));
+        field("Alarm", "OFF");
+        field("Relay", "OFF");
+        field("AR", 0);
+        if (config_.profile == Profile::Bmv)
+            field("BMV", "712 Smart");
+        else
+            field("MON", 0);
+        field("FW", "0413");
+    }
+
+    void history_block() {
+        static constexpr long history[] = {-121830, -8917, -208530, 411, 0, -10238390, 7839, 29112, 4731, 0, 0, 0, 22710, 0, 14, 29221, 3718800, 4023900};
+        char name[4] = "H";
+        for (int i = 0; i < 18; i++) {
+            auto res = std::to_chars(name + 1, name + sizeof(name), i + 1);
+            field(std::string_view(name, res.ptr - name), history[i]);
+        }
+    }
+
+    GeneratorConfig config_;
+    std::mt19937 rng_;
+    std::string block_;
+    bool history_next_ = false;
+
+    long voltage_ = 27000;              // mV
+    long current_ = 1000;               // mA
+    long panel_voltage_ = 60000;        // mV
+    long soc_ = 870;                    // Per mille
+    long consumed_ = -5000;             // mAh
+    long power_ = 0;                    // W
+    long panel_power_ = 0;              // W
+};
+
+#endif // VEGEN_H
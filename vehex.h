@@ -0,0 +1,214 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// The VE.Direct HEX protocol: decoding the HEX-messages that a device sends between the text frames.
+// From: VE.Direct-HEX-Protocol
+//   ":" <command> <data> <checksum> "\n"
+// The command is 1 hex digit, every data byte and the checksum are 2 hex digits (uppercase). The sum of the
+// command and all bytes, including the checksum, is 0x55. The register messages (Get, Set and the asynchronous
+// updates) carry:
+//   <register id: 2 bytes> <flags: 1 byte> <value: 0 or more bytes>
+// with the register id and the value little endian.
+
+#ifndef VEHEX_H
+#define VEHEX_H
+
+// C++ header files
+#include <array>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
+
+// C header files
+#include <cstdint>
+#include <cstddef>
+
+// The responses of a device (the first hex digit after the ':')
+enum class HexResponse : unsigned char {
+    Done = 0x1,
+    Unknown = 0x3,
+    Error = 0x4,
+    Ping = 0x5,
+    Get = 0x7,
+    Set = 0x8,
+    Async = 0xA                         // Sent on its own, e.g. when a register changes
+};
+
+// The flags of a register message
+inline constexpr std::uint8_t hex_flag_unknown_id = 0x01;
+inline constexpr std::uint8_t hex_flag_not_supported = 0x02;
+inline constexpr std::uint8_t hex_flag_parameter_error = 0x04;
+
+inline constexpr std::size_t hex_max_data = 64;     // Data bytes, the longest register value is a 32 character string
+
+struct HexMessage {
+    unsigned char command = 0;
+    std::size_t size = 0;                           // Number of data bytes (without the checksum)
+    std::array<std::uint8_t, hex_max_data> data{};
+
+    // A register message: Get, Set or Async with at least the register id and the flags
+    bool is_register() const {
+        auto response = static_cast<HexResponse>(command);
+        return size >= 3 && (response == HexResponse::Get || response == HexResponse::Set || response == HexResponse::Async);
+    }
+    std::uint16_t reg() const { return data[0] | data[1] << 8; }
+    std::uint8_t flags() const { return data[2]; }
+    std::size_t value_size() const { return size - 3; }
+    const std::uint8_t *value() const { return data.data() + 3; }
+};
+
+enum class HexStatus {
+    Valid,
+    Malformed,                          // Not ":" <hex digits> "\n", an odd number of digits or too long
+    ChecksumError
+};
+
+inline int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Decode one HEX-message, from the ':' up to and including the '\n' (as BlockParser hands it over)
+inline HexStatus decode_hex_message(std::string_view text, HexMessage &message) {
+    if (text.size() < 4 || text.front() != ':' || text.back() != '\n')
+        return HexStatus::Malformed;
+    text.remove_prefix(1);
+    text.remove_suffix(1);
+    if (!text.empty() && text.back() == '\r')
+        text.remove_suffix(1);
+    // The command and the checksum are always there, the data bytes are 2 digits each
+    if (text.size() < 3 || text.size() % 2 == 0 || (text.size() - 3) / 2 > hex_max_data)
+        return HexStatus::Malformed;
+
+    int command = hex_digit_value(text[0]);
+    if (command < 0)
+        return HexStatus::Malformed;
+    message.command = command;
+    std::uint8_t sum = command;
+    std::size_t bytes = (text.size() - 1) / 2;
+    for (std::size_t i = 0; i < bytes; i++) {
+        int high = hex_digit_value(text[1 + 2 * i]);
+        int low = hex_digit_value(text[2 + 2 * i]);
+        if (high < 0 || low < 0)
+            return HexStatus::Malformed;
+        std::uint8_t byte = high << 4 | low;
+        sum += byte;
+        if (i + 1 < bytes)
+            message.data[i] = byte;
+    }
+    message.size = bytes - 1;
+    return sum == 0x55 ? HexStatus::Valid : HexStatus::ChecksumError;
+}
+
+// The registers whose value is signed. Everything else is decoded as unsigned.
+// (The units are in the HEX protocol document, e.g. 0xED8D is 0.01 V and 0xED8F is 0.1 A.)
+inline constexpr std::uint16_t hex_signed_registers[] = {
+    0xED8D,                             // Main or channel 1 (battery) voltage
+    0xED8E,                             // Battery power
+    0xED8F,                             // Battery current
+    0xED7D,                             // Auxiliary (starter) voltage
+    0xEDDB,                             // Charger internal temperature
+    0xEEFF,                             // Consumed Ah
+};
+
+inline bool hex_register_is_signed(std::uint16_t reg) {
+    return std::find(std::begin(hex_signed_registers), std::end(hex_signed_registers), reg) != std::end(hex_signed_registers);
+}
+
+// The name of a register in the output: "HEX:" and the register id, e.g. "HEX:0xED8D". The prefix tells the
+// register events apart from the fields of the text frames.
+inline std::string_view format_register_name(std::uint16_t reg, char (&buf)[16]) {
+    static constexpr char hexdigits[] = "0123456789ABCDEF";
+    std::string_view prefix = "HEX:0x";
+    std::copy(prefix.begin(), prefix.end(), buf);
+    for (int i = 0; i < 4; i++)
+        buf[prefix.size() + i] = hexdigits[(reg >> (12 - 4 * i)) & 0x0F];
+    return std::string_view(buf, prefix.size() + 4);
+}
+
+// A register value of up to 8 bytes as an integer (signed for the registers in hex_signed_registers),
+// a longer value as "0x" and its bytes in the order they were received
+inline std::string_view format_register_value(std::uint16_t reg, const std::uint8_t *value, std::size_t size,
+                                              char (&buf)[2 * hex_max_data + 3]) {
+    if (size == 0)
+        return "---";
+    if (size <= 8) {
+        std::uint64_t u = 0;
+        for (std::size_t i = 0; i < size; i++)
+            u |= static_cast<std::uint64_t>(value[i]) << (8 * i);
+        std::to_chars_result result;
+        if (hex_register_is_signed(reg) && size < 8) {
+            std::uint64_t sign = std::uint64_t(1) << (8 * size - 1);
+            result = std::to_chars(buf, buf + sizeof(buf), static_cast<std::int64_t>((u ^ sign) - sign));
+        } else if (hex_register_is_signed(reg)) {
+            result = std::to_chars(buf, buf + sizeof(buf), static_cast<std::int64_t>(u));
+        } else {
+            result = std::to_chars(buf, buf + sizeof(buf), u);
+        }
+        return std::string_view(buf, result.ptr - buf);
+    }
+    static constexpr char hexdigits[] = "0123456789ABCDEF";
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (std::size_t i = 0; i < size; i++) {
+        buf[2 + 2 * i] = hexdigits[value[i] >> 4];
+        buf[3 + 2 * i] = hexdigits[value[i] & 0x0F];
+    }
+    return std::string_view(buf, 2 + 2 * size);
+}
+
+// The commands to a device
+enum class HexCommand : unsigned char {
+    Ping = 0x1,
+    Get = 0x7,
+    Set = 0x8
+};
+
+inline constexpr std::size_t hex_get_size = 11;     // ":7" <register id> <flags> <checksum> "\n"
+
+// Format a Get command for register reg, the reply is a Get response with the same register id
+inline std::string_view format_hex_get(std::uint16_t reg, char (&buf)[hex_get_size]) {
+    static constexpr char hexdigits[] = "0123456789ABCDEF";
+    std::uint8_t bytes[4] = {static_cast<std::uint8_t>(reg & 0xFF), static_cast<std::uint8_t>(reg >> 8), 0x00, 0};
+    std::uint8_t sum = static_cast<std::uint8_t>(HexCommand::Get) + bytes[0] + bytes[1] + bytes[2];
+    bytes[3] = 0x55 - sum;
+    buf[0] = ':';
+    buf[1] = hexdigits[static_cast<int>(HexCommand::Get)];
+    for (int i = 0; i < 4; i++) {
+        buf[2 + 2 * i] = hexdigits[bytes[i] >> 4];
+        buf[3 + 2 * i] = hexdigits[bytes[i] & 0x0F];
+    }
+    buf[10] = '\n';
+    return std::string_view(buf, hex_get_size);
+}
+
+#endif // VEHEX_H
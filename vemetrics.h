@@ -0,0 +1,336 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Metrics of vicread (--metrics) in the Prometheus text format, served on a Unix socket or TCP port, or
+// periodically written to a file. Every counter and histogram has a single thread that updates it, so recording
+// a value costs a few instructions and no synchronisation, while the event loop can read them at any time.
+
+#ifndef VEMETRICS_H
+#define VEMETRICS_H
+
+// C++ header files
+#include <array>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+
+// C header files
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+// Linux header files
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Counter that is updated by one thread and can be read by any thread. The relaxed atomic load and store
+// compile to plain memory accesses, there is no locked read-modify-write.
+class Counter {
+public:
+    Counter &operator+=(std::uint64_t n) {
+        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        return *this;
+    }
+
+    Counter &operator++() { return *this += 1; }
+    void operator++(int) { *this += 1; }
+
+    operator std::uint64_t() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+// Histogram of durations with fixed exponential buckets (powers of 4, from 1 us up to 4 s)
+class Histogram {
+public:
+    static constexpr std::size_t bucket_count = 12;
+
+    void record(std::int64_t ns) {
+        std::size_t bucket = 0;
+        while (bucket < bucket_count && ns > bound_ns(bucket))
+            bucket++;
+        counts_[bucket]++;
+        count_++;
+        sum_ns_ += ns;
+    }
+
+    std::uint64_t count() const { return count_; }
+    std::uint64_t sum_ns() const { return sum_ns_; }
+
+    static constexpr std::int64_t bound_ns(std::size_t bucket) { return std::int64_t{1000} << (2 * bucket); }
+
+    // Append the histogram in the Prometheus text format (cumulative buckets, in seconds)
+    void append_prometheus(std::string &out, std::string_view name, std::string_view labels) const {
+        char buf[32];
+        std::uint64_t cumulative = 0;
+        for (std::size_t bucket = 0; bucket <= bucket_count; bucket++) {
+            cumulative += counts_[bucket];
+            out += name;
+            out += "_bucket{";
+            out += labels;
+            out += labels.empty() ? "le=\"" : ",le=\"";
+            if (bucket == bucket_count) {
+                out += "+Inf";
+            } else {
+                auto res = std::to_chars(buf, buf + sizeof(buf), bound_ns(bucket) / 1e9);
+                out.append(buf, res.ptr);
+            }
+            out += "\"} ";
+            out += std::to_string(cumulative);
+            out += '\n';
+        }
+        auto res = std::to_chars(buf, buf + sizeof(buf), static_cast<std::uint64_t>(sum_ns_) / 1e9);
+        out += name;
+        out += "_sum{";
+        out += labels;
+        out += "} ";
+        out.append(buf, res.ptr);
+        out += '\n';
+        out += name;
+        out += "_count{";
+        out += labels;
+        out += "} ";
+        out += std::to_string(static_cast<std::uint64_t>(count_));
+        out += '\n';
+    }
+
+private:
+    std::array<Counter, bucket_count + 1> counts_{};           // The last bucket is +Inf
+    Counter count_;
+    Counter sum_ns_;
+};
+
+inline void append_prometheus_help(std::string &out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+inline void append_prometheus_sample(std::string &out, std::string_view name, std::string_view labels, std::uint64_t value) {
+    out += name;
+    out += '{';
+    out += labels;
+    out += "} ";
+    out += std::to_string(value);
+    out += '\n';
+}
+
+// A label for a sample, e.g. device="/dev/ttyUSB0", with the value escaped
+inline std::string prometheus_label(std::string_view name, std::string_view value) {
+    std::string label{name};
+    label += "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"')
+            label += '\\';
+        if (c == '\n')
+            label += "\\n";
+        else
+            label += c;
+    }
+    label += '"';
+    return label;
+}
+
+// Where the metrics go: "unix:<path>", "tcp:[<address>:]<port>" (default address 127.0.0.1) or "file:<path>[,<seconds>]"
+class MetricsEndpoint {
+public:
+    MetricsEndpoint() = default;
+    MetricsEndpoint(const MetricsEndpoint &) = delete;
+    MetricsEndpoint &operator=(const MetricsEndpoint &) = delete;
+    ~MetricsEndpoint() {
+        if (fd_ != -1) {
+            close(fd_);
+            if (!unix_path_.empty())
+                unlink(unix_path_.c_str());
+        }
+    }
+
+    // Returns false and sets errno on failure (EINVAL for an invalid spec)
+    bool open(std::string_view spec) {
+        if (spec.starts_with("file:")) {
+            spec.remove_prefix(5);
+            auto comma = spec.find(',');
+            file_path_ = spec.substr(0, comma);
+            bool valid = true;
+            if (comma != std::string_view::npos) {
+                auto interval = spec.substr(comma + 1);
+                long seconds = 0;
+                auto res = std::from_chars(interval.data(), interval.data() + interval.size(), seconds);
+                valid = !interval.empty() && res.ec == std::errc() && res.ptr == interval.data() + interval.size();
+                file_interval_ = std::chrono::seconds(seconds);
+            }
+            if (!valid || file_path_.empty() || file_interval_.count() <= 0) {
+                errno = EINVAL;
+                return false;
+            }
+            next_dump_ = std::chrono::steady_clock::now() + file_interval_;
+            return true;
+        }
+        if (spec.starts_with("unix:")) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            unix_path_ = spec.substr(5);
+            if (unix_path_.empty() || unix_path_.size() >= sizeof(addr.sun_path)) {
+                errno = EINVAL;
+                return false;
+            }
+            std::memcpy(addr.sun_path, unix_path_.data(), unix_path_.size());
+            unlink(unix_path_.c_str());     // Left behind by a previous run
+            return listen_on(AF_UNIX, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        }
+        if (spec.starts_with("tcp:")) {
+            spec.remove_prefix(4);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            std::string address = "127.0.0.1";
+            auto colon = spec.rfind(':');
+            if (colon != std::string_view::npos) {
+                address = spec.substr(0, colon);
+                spec.remove_prefix(colon + 1);
+            }
+            unsigned port = 0;
+            auto res = std::from_chars(spec.data(), spec.data() + spec.size(), port);
+            if (res.ec != std::errc() || res.ptr != spec.data() + spec.size() || port == 0 || port > 65535 ||
+                inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+                errno = EINVAL;
+                return false;
+            }
+            addr.sin_port = htons(port);
+            return listen_on(AF_INET, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        }
+        errno = EINVAL;
+        return false;
+    }
+
+    // Listening socket for the event loop, -1 when the metrics go to a file
+    int fd() const { return fd_; }
+
+    // Milliseconds until the next file dump, -1 if there is no deadline
+    int timeout_ms() const {
+        if (file_path_.empty())
+            return -1;
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(next_dump_ - std::chrono::steady_clock::now());
+        return std::max(0, static_cast<int>(left.count()));
+    }
+
+    bool dump_due() const { return !file_path_.empty() && std::chrono::steady_clock::now() >= next_dump_; }
+
+    // Replace the file with the metrics (via a temporary file, so readers never see a partial file)
+    void dump(std::string_view text) {
+        next_dump_ = std::chrono::steady_clock::now() + file_interval_;
+        std::string tmp = file_path_ + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            return;
+        bool ok = write_all(fd, text, false, -1);
+        close(fd);
+        if (ok)
+            std::rename(tmp.c_str(), file_path_.c_str());
+    }
+
+    // Answer one scrape: accept the connection, read the (HTTP) request and send the metrics.
+    // A slow client is given at most client_timeout_ms for each step, so it can't stall the event loop.
+    void serve(std::string_view text) {
+        int client = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client == -1)
+            return;
+        pollfd pfd{client, POLLIN, 0};
+        if (poll(&pfd, 1, client_timeout_ms) == 1) {
+            char request[4096];
+            ssize_t n = read(client, request, sizeof(request));
+            (void)n;    // Whatever was asked, the answer is the metrics
+        }
+        std::string header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                             std::to_string(text.size()) + "\r\n\r\n";
+        if (write_all(client, header, true, client_timeout_ms))
+            write_all(client, text, true, client_timeout_ms);
+        close(client);
+    }
+
+private:
+    static constexpr int client_timeout_ms = 100;
+
+    bool listen_on(int family, sockaddr *addr, socklen_t len) {
+        fd_ = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd_ == -1)
+            return false;
+        int one = 1;
+        if (family == AF_INET)
+            setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd_, addr, len) != 0 || listen(fd_, 8) != 0) {
+            int err = errno;
+            close(fd_);
+            fd_ = -1;
+            unix_path_.clear();
+            errno = err;
+            return false;
+        }
+        return true;
+    }
+
+    // Write everything, waiting at most timeout_ms (-1 is forever) each time the fd can't take more.
+    // A client that went away must not raise SIGPIPE (which stops vicread), hence send() with MSG_NOSIGNAL.
+    static bool write_all(int fd, std::string_view text, bool socket, int timeout_ms) {
+        while (!text.empty()) {
+            ssize_t n = socket ? send(fd, text.data(), text.size(), MSG_NOSIGNAL) : write(fd, text.data(), text.size());
+            if (n >= 0) {
+                text.remove_prefix(n);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pollfd pfd{fd, POLLOUT, 0};
+                if (poll(&pfd, 1, timeout_ms) != 1)
+                    return false;
+            } else if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    std::string unix_path_;
+    std::string file_path_;
+    std::chrono::seconds file_interval_{10};
+    std::chrono::steady_clock::time_point next_dump_{};
+};
+
+#endif // VEMETRICS_H
@@ -0,0 +1,445 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Output stage of vicread: the buffer that sends every block to stdout with a single write() (or to the writer
+// thread of --threads), and the blocks, HEX register updates and aggregation windows in each output format.
+// Shared with vetest, so the allocation test runs the same code as vicread.
+
+#ifndef VEOUTPUT_H
+#define VEOUTPUT_H
+
+// C++ header files
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <algorithm>
+#include <charconv>
+#include <semaphore>
+
+// C header files
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+// Linux header files
+#include <unistd.h>
+#include <poll.h>
+
+#include "vedirect.h"
+#include "vebinary.h"
+#include "vehex.h"
+#include "vequeue.h"
+
+inline std::int64_t clock_ns(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// When to write the buffered output to stdout (--flush)
+enum class FlushPolicy {
+    Block,                              // After every block (lowest latency)
+    Interval,                           // At most once per interval
+    None                                // Only when the buffer is full (highest throughput)
+};
+
+// Formatted output on its way from a worker thread to the writer thread (--threads)
+struct OutputSlot {
+    static constexpr std::size_t capacity = 4096 - 8;
+
+    std::uint32_t size;
+    char data[capacity];
+};
+
+// Output stage: the accepted lines are collected in a buffer, so a whole block goes to stdout with a single write()
+// instead of one flush (and one write syscall) per field.
+// On a worker thread (--threads) the blocks go to the writer thread through a queue instead of to stdout.
+class OutputWriter {
+public:
+    OutputWriter() { buf_.reserve(capacity); }
+
+    void set_policy(FlushPolicy policy, std::chrono::milliseconds interval) {
+        policy_ = policy;
+        interval_ = interval;
+    }
+
+    // Write to fd instead of stdout
+    void set_fd(int fd) { fd_ = fd; }
+
+    FlushPolicy policy() const { return policy_; }
+    std::chrono::milliseconds interval() const { return interval_; }
+
+    // Send the blocks to the writer thread: through queue, and release ready for every block
+    void set_queue(SpscQueue<OutputSlot> *queue, std::counting_semaphore<> *ready) {
+        queue_ = queue;
+        ready_ = ready;
+    }
+
+    void append(std::string_view text) {
+        if (buf_.size() + text.size() > capacity && queue_ == nullptr)
+            flush();
+        buf_ += text;
+    }
+
+    void append(char c) {
+        if (buf_.size() == capacity && queue_ == nullptr)
+            flush();
+        buf_ += c;
+    }
+
+    // Called after every block. Returns false when the block was dropped, because the writer thread can't keep up.
+    bool end_block() {
+        if (queue_ != nullptr)
+            return push_block();
+        if (policy_ == FlushPolicy::Block || (policy_ == FlushPolicy::Interval && std::chrono::steady_clock::now() >= next_flush_))
+            flush();
+        return true;
+    }
+
+    // Milliseconds until the buffered output must be written (for the event loop), -1 if there is no deadline
+    int timeout_ms() const {
+        if (policy_ != FlushPolicy::Interval || buf_.empty())
+            return -1;
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(next_flush_ - std::chrono::steady_clock::now());
+        return std::max(0, static_cast<int>(left.count()));
+    }
+
+    // Write the buffered output when the interval has expired
+    void poll() {
+        if (policy_ == FlushPolicy::Interval && !buf_.empty() && std::chrono::steady_clock::now() >= next_flush_)
+            flush();
+    }
+
+    // Write everything, taking care of short writes
+    void flush() {
+        if (queue_ != nullptr) {
+            push_block();
+            return;
+        }
+        std::size_t pos = 0;
+        while (pos < buf_.size()) {
+            ssize_t n = write(fd_, buf_.data() + pos, buf_.size() - pos);
+            if (n >= 0) {
+                pos += n;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // stdout is non-blocking (set by whoever opened it), wait until it can take more
+                pollfd pfd{fd_, POLLOUT, 0};
+                ::poll(&pfd, 1, -1);
+            } else if (errno != EINTR) {
+                // EPIPE only gets here when SIGPIPE is ignored, otherwise handleSIGPIPE() already took care of it
+                std::cerr << "Error writing to stdout: " << std::strerror(errno) << ". Exiting..." << std::endl;
+                exit(errno == EPIPE ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+        }
+        buf_.clear();
+        next_flush_ = std::chrono::steady_clock::now() + interval_;
+    }
+
+private:
+    static constexpr std::size_t capacity = 64 * 1024;
+
+    // All or nothing: a block that doesn't fit in the queue is dropped as a whole
+    bool push_block() {
+        std::size_t slots = (buf_.size() + OutputSlot::capacity - 1) / OutputSlot::capacity;
+        bool fits = queue_->free_slots() >= slots;
+        if (fits && slots > 0) {
+            for (std::size_t i = 0; i < slots; i++) {
+                OutputSlot *slot = queue_->reserve(i);
+                slot->size = std::min(OutputSlot::capacity, buf_.size() - i * OutputSlot::capacity);
+                std::memcpy(slot->data, buf_.data() + i * OutputSlot::capacity, slot->size);
+            }
+            queue_->commit(slots);
+            ready_->release();
+        }
+        buf_.clear();
+        return fits;
+    }
+
+    std::string buf_;
+    int fd_ = STDOUT_FILENO;
+    SpscQueue<OutputSlot> *queue_ = nullptr;
+    std::counting_semaphore<> *ready_ = nullptr;
+    FlushPolicy policy_ = FlushPolicy::Block;
+    std::chrono::milliseconds interval_{0};
+    std::chrono::steady_clock::time_point next_flush_{};
+};
+
+// Format of the output on stdout (--format)
+enum class OutputFormat {
+    Text,                               // <name>\t<value> lines, like the VE.Direct protocol itself
+    Binary,                             // Length-prefixed records, see vebinary.h
+    Csv,                                // One row per field: time, device, name and typed value
+    Jsonl                               // One JSON object per block (JSON Lines)
+};
+
+
+// Binary records are built here first, because the length goes in front. Reused, so it doesn't allocate.
+inline thread_local std::string binary_record;
+
+inline void append_number(OutputWriter &out, std::int64_t number) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), number);
+    out.append(std::string_view(buf, res.ptr - buf));
+}
+
+// Text is always quoted in the CSV output, so numbers and text can be told apart
+inline void append_csv_string(OutputWriter &out, std::string_view text) {
+    out.append('"');
+    for (char c : text) {
+        if (c == '"')
+            out.append('"');
+        out.append(c);
+    }
+    out.append('"');
+}
+
+inline void append_json_string(OutputWriter &out, std::string_view text) {
+    static constexpr char hexdigits[] = "0123456789abcdef";
+    out.append('"');
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out.append('\\');
+            out.append(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out.append("\\u00");
+            out.append(hexdigits[c >> 4]);
+            out.append(hexdigits[c & 0x0F]);
+        } else {
+            out.append(c);
+        }
+    }
+    out.append('"');
+}
+
+// The device the output is about: its index on the command line (binary format) and its label. With labels the
+// text lines start with the label (when reading more than 1 device or when a label is given).
+struct OutputDevice {
+    std::uint16_t id;
+    std::string_view label;
+    bool labels;
+};
+
+// The announcement of a device, before any of its blocks
+inline void output_device(OutputWriter &out, OutputFormat format, OutputDevice const &dev) {
+    if (format == OutputFormat::Binary) {
+        encode_device_record(binary_record, dev.id, dev.labels, dev.label);
+        out.append(binary_record);
+    }
+}
+
+// The fields of a valid block for which accept(field) is true
+template <typename Accept>
+void output_block(OutputWriter &out, OutputFormat format, OutputDevice const &dev, Fields const &fields, Accept &&accept) {
+    switch (format) {
+    case OutputFormat::Text:
+        for (auto const &field : fields) {
+            if (accept(field)) {
+                if (dev.labels) {
+                    out.append(dev.label);
+                    out.append('\t');
+                }
+                out.append(field.name);
+                out.append('\t');
+                out.append(field.value);
+                out.append('\n');
+            }
+        }
+        break;
+    case OutputFormat::Binary:
+        encode_block_record(binary_record, dev.id, clock_ns(CLOCK_MONOTONIC), clock_ns(CLOCK_REALTIME), fields, accept);
+        out.append(binary_record);
+        break;
+    case OutputFormat::Csv: {
+        auto now = clock_ns(CLOCK_REALTIME);
+        for (auto const &field : fields) {
+            if (accept(field)) {
+                append_number(out, now);
+                out.append(',');
+                append_csv_string(out, dev.label);
+                out.append(',');
+                out.append(field.name);
+                out.append(',');
+                if (field.numeric)
+                    append_number(out, field.number);
+                else
+                    append_csv_string(out, field.value);
+                out.append('\n');
+            }
+        }
+        break;
+    }
+    case OutputFormat::Jsonl:
+        out.append("{\"time_ns\":");
+        append_number(out, clock_ns(CLOCK_REALTIME));
+        out.append(",\"device\":");
+        append_json_string(out, dev.label);
+        for (auto const &field : fields) {
+            if (accept(field)) {
+                out.append(',');
+                append_json_string(out, field.name);
+                out.append(':');
+                if (!field.numeric)
+                    append_json_string(out, field.value);
+                else if (field_dictionary[field.id].type == FieldType::OnOff)
+                    out.append(field.number ? "true" : "false");
+                else
+                    append_number(out, field.number);
+            }
+        }
+        out.append("}\n");
+        break;
+    }
+}
+
+// The register update of a HEX-message, with the name "HEX:<register id>"
+inline void output_hex(OutputWriter &out, OutputFormat format, OutputDevice const &dev, HexMessage const &message) {
+    char name_buf[16];
+    char value_buf[2 * hex_max_data + 3];
+    auto name = format_register_name(message.reg(), name_buf);
+    auto value = format_register_value(message.reg(), message.value(), message.value_size(), value_buf);
+
+    switch (format) {
+    case OutputFormat::Text:
+        if (dev.labels) {
+            out.append(dev.label);
+            out.append('\t');
+        }
+        out.append(name);
+        out.append('\t');
+        out.append(value);
+        out.append('\n');
+        break;
+    case OutputFormat::Binary:
+        encode_hex_record(binary_record, dev.id, clock_ns(CLOCK_MONOTONIC), clock_ns(CLOCK_REALTIME), message);
+        out.append(binary_record);
+        break;
+    case OutputFormat::Csv:
+        append_number(out, clock_ns(CLOCK_REALTIME));
+        out.append(',');
+        append_csv_string(out, dev.label);
+        out.append(',');
+        out.append(name);
+        out.append(',');
+        out.append(value);
+        out.append('\n');
+        break;
+    case OutputFormat::Jsonl:
+        out.append("{\"time_ns\":");
+        append_number(out, clock_ns(CLOCK_REALTIME));
+        out.append(",\"device\":");
+        append_json_string(out, dev.label);
+        out.append(",\"source\":\"hex\",\"command\":");
+        append_number(out, message.command);
+        out.append(",");
+        append_json_string(out, name);
+        out.append(':');
+        if (message.value_size() <= 8 && message.value_size() > 0)
+            out.append(value);
+        else
+            append_json_string(out, value);
+        out.append("}\n");
+        break;
+    }
+}
+
+// The summary of an aggregation window (--aggregate)
+inline void output_window(OutputWriter &out, OutputFormat format, OutputDevice const &dev, Aggregator const &window) {
+    switch (format) {
+    case OutputFormat::Text:
+        for_each_summary_line(window, [&out, &dev](std::string_view name, std::string_view suffix, std::string_view value) {
+            if (dev.labels) {
+                out.append(dev.label);
+                out.append('\t');
+            }
+            out.append(name);
+            out.append(suffix);
+            out.append('\t');
+            out.append(value);
+            out.append('\n');
+        });
+        break;
+    case OutputFormat::Binary:
+        encode_window_record(binary_record, dev.id, clock_ns(CLOCK_MONOTONIC), window);
+        out.append(binary_record);
+        break;
+    case OutputFormat::Csv:
+        for_each_summary_line(window, [&out, &dev, &window](std::string_view name, std::string_view suffix, std::string_view value) {
+            append_number(out, window.end_ns);
+            out.append(',');
+            append_csv_string(out, dev.label);
+            out.append(',');
+            out.append(name);
+            out.append(suffix);
+            out.append(',');
+            out.append(value);
+            out.append('\n');
+        });
+        break;
+    case OutputFormat::Jsonl: {
+        out.append("{\"time_ns\":");
+        append_number(out, window.end_ns);
+        out.append(",\"start_ns\":");
+        append_number(out, window.start_ns);
+        out.append(",\"device\":");
+        append_json_string(out, dev.label);
+        // The summary lines of a field come in the order count, mean, min, max, last
+        std::string_view current;
+        for_each_summary_line(window, [&out, &current](std::string_view name, std::string_view suffix, std::string_view value) {
+            if (suffix == "_mWh") {
+                if (!current.empty())
+                    out.append('}');
+                current = {};
+                out.append(",\"P_mWh\":");
+                out.append(value);
+                return;
+            }
+            if (suffix == "_count") {
+                if (!current.empty())
+                    out.append('}');
+                current = name;
+                out.append(',');
+                append_json_string(out, name);
+                out.append(":{\"count\":");
+            } else {
+                out.append(",\"");
+                out.append(suffix.substr(1));
+                out.append("\":");
+            }
+            out.append(value);
+        });
+        if (!current.empty())
+            out.append('}');
+        out.append("}\n");
+        break;
+    }
+    }
+}
+
+#endif // VEOUTPUT_H
@@ -0,0 +1,115 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread (vicread --threads).
+// All slots are allocated up front. The producer fills a slot in place (reserve + commit) and the consumer uses
+// it in place (front + pop), so there is no copying and no allocation after construction. Each side only
+// writes its own index; it keeps a cached copy of the other index and only reads the shared one when the cached
+// copy says the queue is full (producer) or empty (consumer).
+
+#ifndef VEQUEUE_H
+#define VEQUEUE_H
+
+// C++ header files
+#include <atomic>
+#include <memory>
+
+// C header files
+#include <cstddef>
+
+template <typename T>
+class SpscQueue {
+public:
+    // The capacity is rounded up to a power of 2
+    explicit SpscQueue(std::size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity)
+            capacity_ *= 2;
+        slots_ = std::make_unique<T[]>(capacity_);
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    std::size_t capacity() const { return capacity_; }
+
+    // Number of slots in use. Any thread may call this, the result is a snapshot.
+    std::size_t depth() const {
+        auto head = head_.load(std::memory_order_acquire);     // First, so it can't be ahead of tail
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+    // Producer: the next free slot, nullptr when the queue is full. The slot is only handed over by commit().
+    T *reserve() {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - producer_head_ == capacity_) {
+            producer_head_ = head_.load(std::memory_order_acquire);
+            if (tail - producer_head_ == capacity_)
+                return nullptr;
+        }
+        return &slots_[tail & (capacity_ - 1)];
+    }
+
+    // Producer: the n-th free slot after the one reserve() returns, for a producer that fills several slots
+    // before it commits them. Only valid when free_slots() > n.
+    T *reserve(std::size_t n) { return &slots_[(tail_.load(std::memory_order_relaxed) + n) & (capacity_ - 1)]; }
+
+    // Producer: hand the n reserved slots over to the consumer
+    void commit(std::size_t n = 1) { tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+    // Producer: the number of free slots
+    std::size_t free_slots() {
+        producer_head_ = head_.load(std::memory_order_acquire);
+        return capacity_ - (tail_.load(std::memory_order_relaxed) - producer_head_);
+    }
+
+    // Consumer: the oldest slot, nullptr when the queue is empty
+    T *front() {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == consumer_tail_) {
+            consumer_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == consumer_tail_)
+                return nullptr;
+        }
+        return &slots_[head & (capacity_ - 1)];
+    }
+
+    // Consumer: give the oldest slot back to the producer
+    void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+    std::size_t capacity_;
+    std::unique_ptr<T[]> slots_;
+
+    // The indices only increase (and wrap around), the slot is index & (capacity - 1)
+    alignas(64) std::atomic<std::size_t> head_{0};     // Written by the consumer
+    std::size_t consumer_tail_ = 0;                     // The consumer's copy of tail_
+    alignas(64) std::atomic<std::size_t> tail_{0};     // Written by the producer
+    std::size_t producer_head_ = 0;                     // The producer's copy of head_
+};
+
+#endif // VEQUEUE_H
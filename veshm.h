@@ -0,0 +1,288 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Shared-memory latest-value table (vicread --shm=<name>).
+// vicread publishes every valid block in a POSIX shared-memory segment with a fixed layout: a header followed by
+// one entry per device, with the last value of every field in the dictionary (vedirect.h). Labels that are not in
+// the dictionary are not published.
+//
+// Every device entry is protected by a seqlock: the writer makes the sequence number odd, updates the entry and
+// makes it even again. A reader copies the entry and only accepts the copy when the sequence number was even and
+// didn't change in the mean time. So any number of readers take consistent snapshots without locks or syscalls,
+// and they never slow down the writer.
+
+#ifndef VESHM_H
+#define VESHM_H
+
+// C++ header files
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// C header files
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+// Linux header files
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vedirect.h"
+#include "vebinary.h"
+
+inline constexpr std::uint32_t shm_magic = 0x48534556;    // "VESH"
+inline constexpr std::uint16_t shm_version = 1;
+inline constexpr std::size_t shm_label_size = 64;
+inline constexpr std::size_t shm_text_size = 22;
+
+// The last value of one field
+struct ShmValue {
+    std::int64_t number;                // Number, hex and on/off values
+    std::uint8_t state;                 // 0 = not received yet, otherwise 1 + ValueKind
+    std::uint8_t length;                // Length of the text
+    char text[shm_text_size];           // Text values (truncated when longer)
+};
+static_assert(sizeof(ShmValue) == 32);
+
+// Everything a reader copies from a device entry
+struct ShmDeviceData {
+    char label[shm_label_size];
+    std::uint64_t blocks;               // Valid blocks published so far
+    std::int64_t updated_ns;            // CLOCK_REALTIME of the last block
+    ShmValue values[field_count];       // Indexed by field id
+};
+
+struct alignas(64) ShmDevice {
+    std::atomic<std::uint32_t> seq;     // Odd while the writer updates the entry
+    ShmDeviceData data;
+};
+
+struct alignas(64) ShmHeader {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t device_count;
+    std::uint32_t field_count;          // Size of the dictionary of the writer
+    std::uint32_t device_size;          // sizeof(ShmDevice)
+    std::atomic<std::int32_t> writer_pid;   // 0 after the writer stopped
+};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free && std::atomic<std::int32_t>::is_always_lock_free);
+
+inline std::size_t shm_size(std::size_t device_count) {
+    return sizeof(ShmHeader) + device_count * sizeof(ShmDevice);
+}
+
+// Writer side, used by vicread
+class ShmWriter {
+public:
+    ShmWriter() = default;
+    ShmWriter(const ShmWriter &) = delete;
+    ShmWriter &operator=(const ShmWriter &) = delete;
+    ~ShmWriter() { close(); }
+
+    // Create (or replace) the segment for these devices. Returns false and sets errno on failure.
+    bool create(std::string const &name, std::vector<std::string_view> const &labels) {
+        // A new segment, so readers that still have an old one mapped see its writer_pid become 0
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd == -1)
+            return false;
+        size_ = shm_size(labels.size());
+        if (ftruncate(fd, size_) != 0) {
+            int err = errno;
+            ::close(fd);
+            errno = err;
+            return false;
+        }
+        void *map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        // The segment is zero filled, so all values are "not received yet"
+        header_ = static_cast<ShmHeader *>(map);
+        devices_ = reinterpret_cast<ShmDevice *>(static_cast<char *>(map) + sizeof(ShmHeader));
+        for (std::size_t i = 0; i < labels.size(); i++) {
+            auto label = labels[i].substr(0, shm_label_size - 1);
+            std::memcpy(devices_[i].data.label, label.data(), label.size());
+        }
+        header_->version = shm_version;
+        header_->device_count = labels.size();
+        header_->field_count = field_count;
+        header_->device_size = sizeof(ShmDevice);
+        header_->writer_pid.store(getpid(), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = shm_magic;
+        return true;
+    }
+
+    bool is_open() const { return header_ != nullptr; }
+
+    // Publish the fields of a valid block of device index
+    void publish(std::size_t index, const Fields &fields, std::int64_t realtime_ns) {
+        ShmDevice &dev = devices_[index];
+        auto seq = dev.seq.load(std::memory_order_relaxed);
+        dev.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (auto const &field : fields) {
+            if (field.id == unknown_field)
+                continue;
+            ShmValue &value = dev.data.values[field.id];
+            auto kind = value_kind(field);
+            value.state = 1 + static_cast<std::uint8_t>(kind);
+            if (kind == ValueKind::Text) {
+                value.length = std::min(field.value.size(), shm_text_size);
+                std::memcpy(value.text, field.value.data(), value.length);
+            } else {
+                value.number = field.number;
+                value.length = kind == ValueKind::Hex ? field.value.size() - 2 : 0;  // Hex digits
+            }
+        }
+        dev.data.blocks++;
+        dev.data.updated_ns = realtime_ns;
+
+        dev.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Tell the readers there are no more updates. The segment stays, so the last values can still be read.
+    void close() {
+        if (header_ == nullptr)
+            return;
+        header_->writer_pid.store(0, std::memory_order_release);
+        munmap(header_, size_);
+        header_ = nullptr;
+        devices_ = nullptr;
+    }
+
+private:
+    ShmHeader *header_ = nullptr;
+    ShmDevice *devices_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Reader side: map the segment read-only and take consistent snapshots of the device entries
+class ShmReader {
+public:
+    static constexpr std::chrono::milliseconds snapshot_timeout{1};
+
+    ShmReader() = default;
+    ShmReader(const ShmReader &) = delete;
+    ShmReader &operator=(const ShmReader &) = delete;
+    ~ShmReader() {
+        if (header_ != nullptr)
+            munmap(const_cast<ShmHeader *>(header_), size_);
+    }
+
+    // Returns false and sets errno on failure (EPROTO when the segment isn't from a compatible vicread)
+    bool open(std::string const &name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(ShmHeader)) {
+            ::close(fd);
+            errno = EPROTO;
+            return false;
+        }
+        size_ = st.st_size;
+        void *map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+        header_ = static_cast<const ShmHeader *>(map);
+        devices_ = reinterpret_cast<const ShmDevice *>(static_cast<const char *>(map) + sizeof(ShmHeader));
+        if (header_->magic != shm_magic || header_->version != shm_version || header_->field_count != field_count ||
+            header_->device_size != sizeof(ShmDevice) || size_ < shm_size(header_->device_count)) {
+            errno = EPROTO;
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    std::size_t device_count() const { return header_->device_count; }
+
+    // Process id of the writer, 0 when it has stopped
+    int writer_pid() const { return header_->writer_pid.load(std::memory_order_acquire); }
+
+    // Whether the writer still runs. writer_pid is only cleared when vicread stops normally, so also check
+    // that the process still exists (it may have been killed).
+    bool writer_running() const {
+        int pid = writer_pid();
+        return pid != 0 && !(kill(pid, 0) == -1 && errno == ESRCH);
+    }
+
+    // Copy the entry of device index. Retries while the writer is busy, which only takes a few microseconds.
+    // Returns false when the entry is still busy after snapshot_timeout: the writer died halfway an update.
+    bool snapshot(std::size_t index, ShmDeviceData &copy) const {
+        const ShmDevice &dev = devices_[index];
+        std::chrono::steady_clock::time_point deadline{};
+        for (unsigned tries = 1;; tries++) {
+            auto before = dev.seq.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                std::memcpy(&copy, &dev.data, sizeof(copy));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (dev.seq.load(std::memory_order_relaxed) == before)
+                    return true;
+            }
+            // A retry almost always succeeds at once, so the clock is only read now and then
+            if (tries % 64 == 0) {
+                auto now = std::chrono::steady_clock::now();
+                if (deadline == std::chrono::steady_clock::time_point{})
+                    deadline = now + snapshot_timeout;
+                else if (now >= deadline)
+                    return false;
+            }
+        }
+    }
+
+private:
+    const ShmHeader *header_ = nullptr;
+    const ShmDevice *devices_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Convert a published value into a DecodedField, e.g. to format it with format_value()
+inline DecodedField shm_field(int id, const ShmValue &value) {
+    DecodedField field{};
+    field.id = id;
+    field.name = field_dictionary[id].label;
+    field.kind = static_cast<ValueKind>(value.state - 1);
+    field.number = value.number;
+    field.hex_digits = value.length;
+    field.text = std::string_view(value.text, std::min<std::size_t>(value.length, shm_text_size));
+    return field;
+}
+
+#endif // VESHM_H
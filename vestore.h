@@ -0,0 +1,700 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Segmented time-series store of vicread (--store=<dir>), queried with vicquery.
+// The validated blocks go to append-only segment files of a limited size. A segment that is complete gets a
+// footer index, so a query only reads the segments and the parts of a segment that overlap its time range.
+// All integers are little endian, varint is LEB128 and signed values are zigzag encoded.
+//
+// Segment file <dir>/<20 digits: sequence number>.vseg. The sequence number is one more than the highest in the
+// directory, so the names sort in the order the segments were written, also when the clock jumps (e.g. the first
+// NTP sync after a boot in 1970). The times are in the header and the footer index, not in the name.
+//   0      4    magic           "VSEG"
+//   4      1    version         Currently 1
+//   5      3    reserved
+//   8      8    created_ns      CLOCK_REALTIME when the segment was created
+//   16     ...  records, then (once complete) the footer record and the trailer
+//
+// Every record:
+//   0      4    length          Total length of the record in bytes, including this header
+//   4      4    crc             CRC-32 (IEEE) of the bytes after this field
+//   8      1    type            1 = device, 2 = block, 3 = footer
+//
+// Device record (type 1), for every device at the start of every segment:
+//   9      2    device_id       Index of the device on the vicread command line
+//   11     ...  label
+//
+// Block record (type 2), one per valid block. Only the fields with a numeric value are stored:
+//   9      1    flags           Bit 0: checkpoint, the time and the values are not a delta (see below)
+//   10     2    device_id
+//   12     var  time            CLOCK_REALTIME ns, minus the time of the previous block of the device
+//   +0     1    field_count
+//   +1     ...  fields: u8 field id (vedirect.h), [u8 hex digits, only for hex fields],
+//                       var value minus the previous value of this field of the device
+// The deltas start from 0 at every checkpoint: the first block of a device in a segment and then every
+// checkpoint_interval blocks of the device. Decoding can start at any checkpoint.
+//
+// Footer record (type 3):
+//   9      2    device_count
+//   11     ...  devices, 36 bytes each: u16 device_id, i64 first_ns, i64 last_ns, u32 blocks,
+//               u8[14] field ids present (bit per field id)
+//   +0     4    checkpoint_count
+//   +4     ...  checkpoints, 14 bytes each: u16 device_id, i64 time_ns, u32 offset of the block record
+//
+// Trailer, the last 8 bytes of a complete segment:
+//   0      4    footer_offset
+//   4      4    magic           "VIDX"
+//
+// A segment without a trailer was not closed (vicread stopped or crashed). Its records are read until the first
+// one that is incomplete or has a wrong CRC, so a torn last record is skipped. When vicread opens the store again
+// it truncates such a segment after its last good record and adds the footer.
+
+#ifndef VESTORE_H
+#define VESTORE_H
+
+// C++ header files
+#include <array>
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <system_error>
+
+// C header files
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+// Linux header files
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vedirect.h"
+#include "vebinary.h"
+
+inline constexpr char store_magic[4] = {'V', 'S', 'E', 'G'};
+inline constexpr char store_trailer_magic[4] = {'V', 'I', 'D', 'X'};
+inline constexpr std::uint8_t store_version = 1;
+inline constexpr std::size_t store_header_size = 16;
+inline constexpr std::size_t store_record_header_size = 9;
+inline constexpr std::size_t store_trailer_size = 8;
+inline constexpr unsigned checkpoint_interval = 64;
+inline constexpr std::size_t store_field_bytes = 14;   // Bit per field id
+static_assert(field_count <= 8 * store_field_bytes);
+
+enum class StoreRecord : std::uint8_t {
+    Device = 1,
+    Block = 2,
+    Footer = 3
+};
+
+constexpr std::array<std::uint32_t, 256> build_crc32_table() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr std::array<std::uint32_t, 256> crc32_table = build_crc32_table();
+
+inline std::uint32_t crc32(std::string_view data) {
+    std::uint32_t crc = 0xFFFFFFFF;
+    for (unsigned char c : data)
+        crc = crc32_table[(crc ^ c) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+inline void append_varint(std::string &out, std::int64_t value) {
+    auto u = (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);    // Zigzag
+    while (u >= 0x80) {
+        out += static_cast<char>((u & 0x7F) | 0x80);
+        u >>= 7;
+    }
+    out += static_cast<char>(u);
+}
+
+// Returns false when data ends in the middle of the varint
+inline bool read_varint(std::string_view &data, std::int64_t &value) {
+    std::uint64_t u = 0;
+    for (unsigned shift = 0; shift < 64 && !data.empty(); shift += 7) {
+        auto byte = static_cast<unsigned char>(data.front());
+        data.remove_prefix(1);
+        u |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            value = static_cast<std::int64_t>(u >> 1) ^ -static_cast<std::int64_t>(u & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The footer index of a segment. The writer keeps it up to date, a reader gets it from the footer or,
+// for a segment that was not closed, by scanning the records.
+struct StoreIndex {
+    struct Device {
+        std::uint16_t id;
+        std::int64_t first_ns;
+        std::int64_t last_ns;
+        std::uint32_t blocks = 0;
+        std::bitset<8 * store_field_bytes> fields;
+    };
+    struct Checkpoint {
+        std::uint16_t device_id;
+        std::int64_t time_ns;
+        std::uint32_t offset;
+    };
+
+    std::vector<Device> devices;
+    std::vector<Checkpoint> checkpoints;
+
+    Device &device(std::uint16_t id) {
+        auto dev = std::find_if(devices.begin(), devices.end(), [id](Device const &d) { return d.id == id; });
+        if (dev != devices.end())
+            return *dev;
+        devices.push_back({id, 0, 0, 0, {}});
+        return devices.back();
+    }
+
+    void add_block(std::uint16_t id, std::int64_t time_ns, std::uint32_t offset, bool checkpoint, std::bitset<8 * store_field_bytes> const &fields) {
+        Device &dev = device(id);
+        if (dev.blocks == 0)
+            dev.first_ns = time_ns;
+        dev.last_ns = time_ns;
+        dev.blocks++;
+        dev.fields |= fields;
+        if (checkpoint)
+            checkpoints.push_back({id, time_ns, offset});
+    }
+
+    void encode(std::string &out) const {
+        append_le(out, static_cast<std::uint16_t>(devices.size()));
+        for (auto const &dev : devices) {
+            append_le(out, dev.id);
+            append_le(out, dev.first_ns);
+            append_le(out, dev.last_ns);
+            append_le(out, dev.blocks);
+            for (std::size_t i = 0; i < store_field_bytes; i++) {
+                std::uint8_t byte = 0;
+                for (int bit = 0; bit < 8; bit++)
+                    byte |= dev.fields.test(8 * i + bit) << bit;
+                out += static_cast<char>(byte);
+            }
+        }
+        append_le(out, static_cast<std::uint32_t>(checkpoints.size()));
+        for (auto const &cp : checkpoints) {
+            append_le(out, cp.device_id);
+            append_le(out, cp.time_ns);
+            append_le(out, cp.offset);
+        }
+    }
+
+    bool decode(std::string_view data) {
+        devices.clear();
+        checkpoints.clear();
+        if (data.size() < 2)
+            return false;
+        std::size_t count = read_le<std::uint16_t>(data.data());
+        data.remove_prefix(2);
+        if (data.size() < count * (22 + store_field_bytes) + 4)
+            return false;
+        for (std::size_t i = 0; i < count; i++, data.remove_prefix(22 + store_field_bytes)) {
+            Device dev{read_le<std::uint16_t>(data.data()), read_le<std::int64_t>(data.data() + 2),
+                       read_le<std::int64_t>(data.data() + 10), read_le<std::uint32_t>(data.data() + 18), {}};
+            for (std::size_t bit = 0; bit < 8 * store_field_bytes; bit++)
+                dev.fields[bit] = (data[22 + bit / 8] >> (bit % 8)) & 1;
+            devices.push_back(dev);
+        }
+        count = read_le<std::uint32_t>(data.data());
+        data.remove_prefix(4);
+        if (data.size() != count * 14)
+            return false;
+        for (std::size_t i = 0; i < count; i++, data.remove_prefix(14))
+            checkpoints.push_back({read_le<std::uint16_t>(data.data()), read_le<std::int64_t>(data.data() + 2), read_le<std::uint32_t>(data.data() + 10)});
+        return true;
+    }
+};
+
+// A stored field value, as a query returns it
+struct StoredValue {
+    std::uint16_t device_id;
+    std::int64_t time_ns;
+    int field_id;
+    std::int64_t number;
+    int hex_digits;                     // Hex fields only
+};
+
+// Convert a stored value into a DecodedField, e.g. to format it with format_value()
+inline DecodedField stored_field(const StoredValue &value) {
+    DecodedField field{};
+    field.id = value.field_id;
+    field.name = field_dictionary[value.field_id].label;
+    switch (field_dictionary[value.field_id].type) {
+    case FieldType::Hex:
+        field.kind = ValueKind::Hex;
+        break;
+    case FieldType::OnOff:
+        field.kind = ValueKind::OnOff;
+        break;
+    default:
+        field.kind = ValueKind::Number;
+        break;
+    }
+    field.number = value.number;
+    field.hex_digits = value.hex_digits;
+    return field;
+}
+
+// The records of a segment: returns the length of the first record in data when it is complete and its CRC is right,
+// otherwise 0 (a torn record at the end of a segment that was not closed)
+inline std::size_t next_store_record(std::string_view data, StoreRecord &type) {
+    if (data.size() < store_record_header_size)
+        return 0;
+    auto length = read_le<std::uint32_t>(data.data());
+    if (length < store_record_header_size || length > data.size())
+        return 0;
+    if (crc32(data.substr(8, length - 8)) != read_le<std::uint32_t>(data.data() + 4))
+        return 0;
+    type = static_cast<StoreRecord>(data[8]);
+    return length;
+}
+
+// Decode the values of a block record. context holds the previous values of the device (the deltas are relative
+// to them) and is updated. Returns false on a corrupt record.
+struct StoreContext {
+    std::int64_t time_ns = 0;
+    std::array<std::int64_t, field_count> values{};
+
+    void reset() { *this = StoreContext{}; }
+};
+
+template <typename ValueHandler>
+inline bool decode_store_block(std::string_view record, StoreContext &context, ValueHandler &&on_value) {
+    record.remove_prefix(store_record_header_size);
+    if (record.size() < 3)
+        return false;
+    bool checkpoint = record[0] & 1;
+    auto device_id = read_le<std::uint16_t>(record.data() + 1);
+    record.remove_prefix(3);
+    if (checkpoint)
+        context.reset();
+    std::int64_t delta;
+    if (!read_varint(record, delta) || record.empty())
+        return false;
+    context.time_ns += delta;
+    unsigned count = static_cast<unsigned char>(record.front());
+    record.remove_prefix(1);
+    for (unsigned i = 0; i < count; i++) {
+        if (record.empty())
+            return false;
+        int id = static_cast<unsigned char>(record.front());
+        record.remove_prefix(1);
+        if (id >= field_count)
+            return false;
+        int digits = 0;
+        if (field_dictionary[id].type == FieldType::Hex) {
+            if (record.empty())
+                return false;
+            digits = static_cast<unsigned char>(record.front());
+            record.remove_prefix(1);
+        }
+        if (!read_varint(record, delta))
+            return false;
+        context.values[id] += delta;
+        on_value(StoredValue{device_id, context.time_ns, id, context.values[id], digits});
+    }
+    return true;
+}
+
+// Read access to one segment file through mmap
+class StoreSegment {
+public:
+    StoreSegment() = default;
+    StoreSegment(const StoreSegment &) = delete;
+    StoreSegment &operator=(const StoreSegment &) = delete;
+    ~StoreSegment() { close(); }
+
+    // Returns false and sets errno on failure (EINVAL: not a segment)
+    bool open(std::string const &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = st.st_size;
+        if (size_ < store_header_size) {
+            ::close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        void *map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+        data_ = static_cast<const char *>(map);
+        if (std::memcmp(data_, store_magic, 4) != 0 || data_[4] != store_version) {
+            close();
+            errno = EINVAL;
+            return false;
+        }
+        load_index();
+        return true;
+    }
+
+    void close() {
+        if (data_ != nullptr)
+            munmap(const_cast<char *>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    std::string_view data() const { return std::string_view(data_, size_); }
+    bool complete() const { return complete_; }         // Closed by the writer, the index comes from the footer
+    std::size_t records_end() const { return records_end_; }    // End of the last good record
+    StoreIndex const &index() const { return index_; }
+    std::vector<std::pair<std::uint16_t, std::string>> const &labels() const { return labels_; }
+
+    // Hand the values of fields (bit per field id) of one device between from_ns and to_ns (inclusive) to on_value().
+    // Decoding starts at the last checkpoint before from_ns and skips the records of the other devices.
+    template <typename ValueHandler>
+    void query(std::uint16_t device_id, std::int64_t from_ns, std::int64_t to_ns,
+               std::bitset<8 * store_field_bytes> const &fields, ValueHandler &&on_value) const {
+        auto dev = std::find_if(index_.devices.begin(), index_.devices.end(), [&](auto const &d) { return d.id == device_id; });
+        if (dev == index_.devices.end() || dev->last_ns < from_ns || dev->first_ns > to_ns || (dev->fields & fields).none())
+            return;
+        std::size_t pos = 0;
+        for (auto const &cp : index_.checkpoints) {
+            if (cp.device_id == device_id && (pos == 0 || cp.time_ns <= from_ns))
+                pos = cp.offset;
+        }
+        StoreContext context;
+        StoreRecord type;
+        std::string_view records = data().substr(0, records_end_);
+        while (std::size_t length = next_store_record(records.substr(pos), type)) {
+            auto record = records.substr(pos, length);
+            pos += length;
+            if (type != StoreRecord::Block || read_le<std::uint16_t>(record.data() + 10) != device_id)
+                continue;
+            bool past_end = false;
+            decode_store_block(record, context, [&](StoredValue const &value) {
+                past_end = value.time_ns > to_ns;
+                if (!past_end && value.time_ns >= from_ns && fields.test(value.field_id))
+                    on_value(value);
+            });
+            if (past_end)
+                break;
+        }
+    }
+
+private:
+    void load_index() {
+        std::string_view file = data();
+        complete_ = false;
+        labels_.clear();
+        if (file.size() >= store_header_size + store_trailer_size &&
+            std::memcmp(file.data() + file.size() - 4, store_trailer_magic, 4) == 0) {
+            std::size_t footer = read_le<std::uint32_t>(file.data() + file.size() - store_trailer_size);
+            StoreRecord type;
+            std::size_t length = footer < file.size() ? next_store_record(file.substr(footer, file.size() - store_trailer_size - footer), type) : 0;
+            if (length > 0 && type == StoreRecord::Footer &&
+                index_.decode(file.substr(footer + store_record_header_size, length - store_record_header_size))) {
+                complete_ = true;
+                records_end_ = footer;
+            }
+        }
+        // Without a (good) footer: rebuild the index from the records, up to the first bad one
+        if (!complete_)
+            index_ = StoreIndex{};
+        std::size_t pos = store_header_size;
+        std::size_t end = complete_ ? records_end_ : file.size();
+        StoreRecord type;
+        std::vector<std::pair<std::uint16_t, StoreContext>> contexts;
+        while (std::size_t length = next_store_record(file.substr(pos, end - pos), type)) {
+            auto record = file.substr(pos, length);
+            if (type == StoreRecord::Device && length >= store_record_header_size + 2) {
+                labels_.emplace_back(read_le<std::uint16_t>(record.data() + store_record_header_size),
+                                     std::string(record.substr(store_record_header_size + 2)));
+            } else if (type == StoreRecord::Block && !complete_) {
+                if (length < store_record_header_size + 3)
+                    break;
+                auto id = read_le<std::uint16_t>(record.data() + 10);
+                auto context = std::find_if(contexts.begin(), contexts.end(), [id](auto const &c) { return c.first == id; });
+                if (context == contexts.end()) {
+                    contexts.emplace_back(id, StoreContext{});
+                    context = contexts.end() - 1;
+                }
+                std::bitset<8 * store_field_bytes> fields;
+                if (!decode_store_block(record, context->second, [&fields](StoredValue const &value) { fields.set(value.field_id); }))
+                    break;
+                index_.add_block(id, context->second.time_ns, pos, record[9] & 1, fields);
+            } else if (complete_ && type == StoreRecord::Block) {
+                break;          // The device records are at the start, the footer has the rest
+            }
+            pos += length;
+        }
+        if (!complete_)
+            records_end_ = pos;
+    }
+
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+    bool complete_ = false;
+    std::size_t records_end_ = 0;
+    StoreIndex index_;
+    std::vector<std::pair<std::uint16_t, std::string>> labels_;
+};
+
+// The segment files of a store directory, oldest first
+inline std::vector<std::string> store_segments(std::string const &dir) {
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (auto const &entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.path().extension() == ".vseg")
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());      // The names are the zero padded sequence numbers
+    return paths;
+}
+
+// The sequence number in the name of a segment file, or false when the name is not a number
+inline bool store_segment_number(std::string const &path, std::uint64_t &number) {
+    auto stem = std::filesystem::path(path).stem().string();
+    auto res = std::from_chars(stem.data(), stem.data() + stem.size(), number);
+    return !stem.empty() && res.ec == std::errc() && res.ptr == stem.data() + stem.size();
+}
+
+// Append-only writer (vicread --store). Not thread safe.
+class StoreWriter {
+public:
+    StoreWriter() = default;
+    StoreWriter(const StoreWriter &) = delete;
+    StoreWriter &operator=(const StoreWriter &) = delete;
+    ~StoreWriter() { close(); }
+
+    // Open the store in dir (created if needed) for these devices, with segments of at most segment_size bytes.
+    // Segments that were not closed are repaired first. Returns false and sets errno on failure.
+    bool open(std::string const &dir, std::vector<std::string_view> const &labels, std::size_t segment_size) {
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        next_segment_ = 0;
+        for (auto const &path : store_segments(dir)) {
+            if (!seal(path))
+                return false;
+            if (std::uint64_t number; store_segment_number(path, number))
+                next_segment_ = std::max(next_segment_, number + 1);
+        }
+        dir_ = dir;
+        labels_.assign(labels.begin(), labels.end());
+        segment_size_ = segment_size;
+        contexts_.assign(labels.size(), Context{});
+        return true;
+    }
+
+    bool is_open() const { return !dir_.empty(); }
+
+    // Append the numeric fields of a valid block. A new segment is started when needed. Returns false and sets errno on failure.
+    bool append(std::uint16_t device_id, const Fields &fields, std::int64_t realtime_ns) {
+        if (fd_ != -1 && size_ >= segment_size_ && !close_segment())
+            return false;
+        if (fd_ == -1 && !open_segment(realtime_ns))
+            return false;
+
+        Context &context = contexts_[device_id];
+        bool checkpoint = context.blocks % checkpoint_interval == 0;
+        if (checkpoint)
+            context.values.reset();
+        begin(StoreRecord::Block);
+        record_ += static_cast<char>(checkpoint ? 1 : 0);
+        append_le(record_, device_id);
+        append_varint(record_, realtime_ns - context.values.time_ns);
+        context.values.time_ns = realtime_ns;
+        std::size_t count_pos = record_.size();
+        record_ += '\0';
+        unsigned count = 0;
+        std::bitset<8 * store_field_bytes> present;
+        for (auto const &field : fields) {
+            if (field.id == unknown_field || !field.numeric || present.test(field.id))
+                continue;
+            present.set(field.id);
+            record_ += static_cast<char>(field.id);
+            if (field_dictionary[field.id].type == FieldType::Hex)
+                record_ += static_cast<char>(field.value.size() - 2);      // Digits, without the "0x"
+            append_varint(record_, field.number - context.values.values[field.id]);
+            context.values.values[field.id] = field.number;
+            count++;
+        }
+        record_[count_pos] = static_cast<char>(count);
+        std::uint32_t offset = size_;
+        if (!write_record())
+            return false;
+        context.blocks++;
+        index_.add_block(device_id, realtime_ns, offset, checkpoint, present);
+        return true;
+    }
+
+    // Complete the current segment (footer and trailer)
+    void close() {
+        if (fd_ != -1)
+            close_segment();
+        dir_.clear();
+    }
+
+private:
+    struct Context {
+        unsigned blocks = 0;            // In the current segment
+        StoreContext values;
+    };
+
+    void begin(StoreRecord type) {
+        record_.clear();
+        append_le<std::uint32_t>(record_, 0);   // Length and CRC are filled in by write_record()
+        append_le<std::uint32_t>(record_, 0);
+        record_ += static_cast<char>(type);
+    }
+
+    // One write() per record, so after a crash only the last record can be incomplete
+    bool write_record() {
+        auto length = static_cast<std::uint32_t>(record_.size());
+        auto crc = crc32(std::string_view(record_).substr(8));
+        for (std::size_t i = 0; i < 4; i++) {
+            record_[i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+            record_[4 + i] = static_cast<char>((crc >> (8 * i)) & 0xFF);
+        }
+        return write_all(record_);
+    }
+
+    bool write_all(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t n = write(fd_, data.data(), data.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return false;
+            data.remove_prefix(n);
+            size_ += n;
+        }
+        return true;
+    }
+
+    bool open_segment(std::int64_t realtime_ns) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%020llu.vseg", static_cast<unsigned long long>(next_segment_++));
+        fd_ = ::open((dir_ + name).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd_ == -1)
+            return false;
+        size_ = 0;
+        index_ = StoreIndex{};
+        for (auto &context : contexts_)
+            context = Context{};
+
+        std::string header(store_magic, 4);
+        header += static_cast<char>(store_version);
+        header.append(3, '\0');
+        append_le(header, realtime_ns);
+        if (!write_all(header))
+            return false;
+        for (std::size_t id = 0; id < labels_.size(); id++) {
+            begin(StoreRecord::Device);
+            append_le(record_, static_cast<std::uint16_t>(id));
+            record_ += labels_[id];
+            if (!write_record())
+                return false;
+        }
+        return true;
+    }
+
+    bool close_segment() {
+        std::uint32_t footer = size_;
+        begin(StoreRecord::Footer);
+        index_.encode(record_);
+        bool ok = write_record();
+        if (ok) {
+            std::string trailer;
+            append_le(trailer, footer);
+            trailer.append(store_trailer_magic, 4);
+            ok = write_all(trailer) && fdatasync(fd_) == 0;
+        }
+        int err = errno;
+        ::close(fd_);
+        fd_ = -1;
+        errno = err;
+        return ok;
+    }
+
+    // Repair a segment that was not closed: cut off a torn last record and add the footer
+    static bool seal(std::string const &path) {
+        StoreSegment segment;
+        if (!segment.open(path))
+            return errno == EINVAL;     // Not a segment (e.g. empty after a crash right after the create): leave it
+        if (segment.complete())
+            return true;
+        StoreWriter writer;
+        writer.begin(StoreRecord::Footer);
+        segment.index().encode(writer.record_);
+        std::uint32_t offset = segment.records_end();
+        segment.close();
+
+        writer.fd_ = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (writer.fd_ == -1)
+            return false;
+        writer.size_ = offset;
+        bool ok = ftruncate(writer.fd_, offset) == 0 && lseek(writer.fd_, offset, SEEK_SET) == offset && writer.write_record();
+        if (ok) {
+            std::string trailer;
+            append_le(trailer, offset);
+            trailer.append(store_trailer_magic, 4);
+            ok = writer.write_all(trailer) && fdatasync(writer.fd_) == 0;
+        }
+        ::close(writer.fd_);
+        writer.fd_ = -1;
+        return ok;
+    }
+
+    std::string dir_;
+    std::vector<std::string> labels_;
+    std::size_t segment_size_ = 0;
+    std::uint64_t next_segment_ = 0;    // Sequence number in the name of the next segment
+    int fd_ = -1;
+    std::size_t size_ = 0;
+    StoreIndex index_;
+    std::vector<Context> contexts_;
+    std::string record_;
+};
+
+#endif // VESTORE_H
@@ -0,0 +1,445 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// Self tests of the VE.Direct code that don't need a device: ./vetest runs all of them, ./vetest <name> one.
+// Every test stops at the first failure with a description on stderr, and vetest exits non-zero.
+
+// C++ header files
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <regex>
+#include <random>
+#include <atomic>
+#include <new>
+
+// C header files
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+// Linux header files
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vedirect.h"
+#include "vegen.h"
+#include "vehex.h"
+#include "veoutput.h"
+#include "ttyusb.h"
+
+// Count every heap allocation (like vebench), for the allocations test.
+// The replacements are not inlined, otherwise GCC warns about free() on memory from operator new.
+static std::atomic<unsigned long> allocations{0};
+
+[[gnu::noinline]] void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// The line with the special characters escaped, for the failure messages
+static std::string escaped(std::string_view line) {
+    static constexpr char hexdigits[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : line) {
+        if (c == '\t')
+            out += "\\t";
+        else if (c == '\r')
+            out += "\\r";
+        else if (c == '\n')
+            out += "\\n";
+        else if (c < 0x20 || c >= 0x7F) {
+            out += "\\x";
+            out += hexdigits[c >> 4];
+            out += hexdigits[c & 0x0F];
+        } else
+            out += static_cast<char>(c);
+    }
+    return out;
+}
+
+// The table driven validator and the regex must accept and reject the same lines. The corpus is every line of the
+// generated blocks of all profiles (with bit errors, bit-7 flips and HEX-messages in them), every single bit flip of
+// the clean blocks, every byte value at every position of the clean lines and a few hand written edge cases.
+static bool test_grammar() {
+    unsigned long lines = 0, accepted = 0;
+    auto check = [&](std::string_view line) {
+        bool table = line_matches_grammar(line);
+        bool regex = std::regex_search(line.begin(), line.end(), ve_direct_line_regex);
+        if (table != regex) {
+            std::cerr << "grammar: \"" << escaped(line) << "\" is " << (table ? "accepted" : "rejected") << " by the table and "
+                      << (regex ? "accepted" : "rejected") << " by the regex" << std::endl;
+            return false;
+        }
+        lines++;
+        accepted += table;
+        return true;
+    };
+
+    // The lines of a block as they are checked: without the \n, with the \r (the last line, "Checksum\t<byte>", is
+    // not checked against the grammar)
+    auto check_lines = [&](std::string_view stream) {
+        std::size_t pos = 0;
+        for (std::size_t end; (end = stream.find('\n', pos)) != std::string_view::npos; pos = end + 1) {
+            if (!check(stream.substr(pos, end - pos)))
+                return false;
+        }
+        return check(stream.substr(pos));
+    };
+
+    static constexpr const char *edge_cases[] = {
+        "", "\r", "V\r", "V\t\r", "V\t0\r", "V\t-\r", "V\t--\r", "V\t---\r", "V\t----\r", "V\t-0\r", "V\t007\r",
+        "V\t0x\r", "V\t0xA\r", "V\t0xa\r", "V\t0X1\r", "V\tON\r", "V\tOFF\r", "V\tO\r", "V\tOF\r", "V\tONN\r",
+        "v\t1\r", "V1a\t1\r", "V_1\t1\r", "V\t1\r\r", "V\t1", "V\t1 \r", "\tV\t1\r",
+        "BMV\t712 Smart\r", "BMV\t712/Smart\r", "BMV\t-1\r", "BMV\t---\r", "BMV\tsmart\r", "BMV\t\r", "BM\t1\r", "BMVX\t1\r",
+        "SER#\tHQ2132ABCDE\r", "SER#\t1\r", "SER#\t-1\r", "SER#\tON\r", "SER\t1\r", "SER#X\t1\r", "S#\t1\r",
+        "FWE\t0419FF\r", "FWE\t-5\r", "FW\t159\r", "FWE\tv1.59\r", "FWEE\t1\r",
+    };
+    for (const char *line : edge_cases) {
+        if (!check(line))
+            return false;
+    }
+
+    for (auto profile : {Profile::Mppt, Profile::SmartShunt, Profile::Bmv}) {
+        GeneratorConfig config;
+        config.profile = profile;
+        config.hex_rate = 0.1;
+        config.bit_error_rate = 0.001;
+        config.msb_flip_rate = 0.01;
+        Generator generator(config);
+        std::string stream, clean;
+        for (int i = 0; i < 2000; i++) {
+            stream.clear();
+            generator.next_block(stream, &clean);
+            if (!check_lines(stream))
+                return false;
+            if (i < 4) {
+                // Every byte value at every position of the clean lines, and every line with a byte removed
+                std::size_t pos = 0;
+                for (std::size_t end; pos < clean.size(); pos = end + 1) {
+                    end = std::min(clean.find('\n', pos), clean.size());
+                    std::string line = clean.substr(pos, end - pos);
+                    for (std::size_t at = 0; at <= line.size(); at++) {
+                        for (int c = 0; c < 256; c++) {
+                            std::string changed = line;
+                            if (at < line.size())
+                                changed[at] = static_cast<char>(c);
+                            else
+                                changed += static_cast<char>(c);
+                            if (!check(changed))
+                                return false;
+                        }
+                        if (at < line.size() && !check(std::string(line).erase(at, 1)))
+                            return false;
+                    }
+                }
+            }
+            if (i >= 20)
+                continue;
+            for (std::size_t pos = 0; pos < clean.size(); pos++) {
+                for (int bit = 0; bit < 8; bit++) {
+                    std::string flipped = clean;
+                    flipped[pos] ^= static_cast<char>(1 << bit);
+                    if (!check_lines(flipped))
+                        return false;
+                }
+            }
+        }
+    }
+    std::cerr << "grammar: " << lines << " lines, " << accepted << " accepted, table and regex agree" << std::endl;
+    return true;
+}
+
+// The steady state of the read path must not allocate: the block parser, the decoded fields, the white list and
+// change filters, the output stage of vicread (veoutput.h) in every format, the HEX-messages, the aggregation windows
+// and the recovery of checksum errors. The output goes to /dev/null. The corpus is parsed once per format to warm up
+// (buffers grow to their final size), the allocations are counted during the second pass of all formats.
+static bool test_allocations() {
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null_fd == -1) {
+        std::cerr << "allocations: can't open /dev/null: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    OutputWriter out;
+    out.set_fd(null_fd);
+    for (auto profile : {Profile::Mppt, Profile::SmartShunt, Profile::Bmv}) {
+        GeneratorConfig config;
+        config.profile = profile;
+        config.hex_rate = 0.1;
+        config.bit_error_rate = 0.0001;
+        Generator generator(config);
+        std::string stream;
+        while (stream.size() < 1024 * 1024)
+            generator.next_block(stream);
+
+        BlockParser parser;
+        parser.keep_errors(true);
+        FieldFilter filter;
+        filter.add("V");
+        filter.add("I");
+        filter.add("P");
+        filter.add("SOC");
+        filter.add("PPV");
+        ChangeFilter changes;
+        Deadbands deadbands{};
+        Aggregator window;
+        OutputDevice device{0, "test", true};
+        OutputFormat format = OutputFormat::Text;
+        std::string fixed;
+        Fields fixed_fields;
+        unsigned long valid_blocks = 0, recovered_blocks = 0, hex_messages = 0;
+
+        // Like print_block() and aggregate_block() of vicread
+        auto send = [&](const Fields &fields) {
+            auto accept = [&](Field const &field) { return filter.accepts(field) && changes.changed(field, deadbands, false); };
+            output_block(out, format, device, fields, accept);
+            out.end_block();
+            window.add(fields, [&filter](Field const &field) { return filter.accepts(field); }, clock_ns(CLOCK_MONOTONIC));
+            if ((valid_blocks + recovered_blocks) % 16 == 0) {
+                output_window(out, format, device, window);
+                out.end_block();
+                window.reset(0, 0);
+            }
+        };
+        auto on_block = [&](const ParsedBlock &block) {
+            if (block.status == BlockStatus::Valid) {
+                valid_blocks++;
+                send(block.fields);
+            } else if (block.status == BlockStatus::ChecksumError && block.complete && recover_block(block.text, fixed) &&
+                       decode_fields(check_block(fixed).lines, fixed_fields)) {
+                recovered_blocks++;
+                send(fixed_fields);
+            }
+        };
+        auto on_hex = [&](std::string_view text) {
+            HexMessage message;
+            if (decode_hex_message(text, message) != HexStatus::Valid || !message.is_register())
+                return;
+            hex_messages++;
+            output_hex(out, format, device, message);
+            out.end_block();
+        };
+        auto parse = [&] {
+            constexpr std::size_t read_size = 512;
+            for (auto each : {OutputFormat::Text, OutputFormat::Binary, OutputFormat::Csv, OutputFormat::Jsonl}) {
+                format = each;
+                output_device(out, format, device);
+                for (std::size_t pos = 0; pos < stream.size(); pos += read_size)
+                    parser.feed(stream.data() + pos, std::min(read_size, stream.size() - pos), on_block, on_hex);
+            }
+        };
+
+        parse();
+        valid_blocks = recovered_blocks = hex_messages = 0;
+        unsigned long before = allocations.load(std::memory_order_relaxed);
+        parse();
+        unsigned long allocated = allocations.load(std::memory_order_relaxed) - before;
+        if (allocated != 0 || valid_blocks == 0 || recovered_blocks == 0 || hex_messages == 0) {
+            std::cerr << "allocations: " << allocated << " heap allocations for " << valid_blocks << " valid blocks, "
+                      << recovered_blocks << " recovered blocks and " << hex_messages << " HEX-messages" << std::endl;
+            close(null_fd);
+            return false;
+        }
+        std::cerr << "allocations: 0 heap allocations for " << valid_blocks << " valid blocks, " << recovered_blocks
+                  << " recovered blocks and " << hex_messages << " HEX-messages in 4 output formats" << std::endl;
+    }
+    close(null_fd);
+    return true;
+}
+
+// recover_block() repairs a single flipped bit only when exactly one candidate fits. A line that is too long for the
+// incremental search can't be searched for candidates, so then the block must not be recovered at all.
+static bool test_recovery() {
+    auto make_block = [](std::string_view lines) {
+        std::string block = "\r\n";
+        block += lines;
+        block += "\r\nChecksum\t";
+        unsigned char sum = 0;
+        for (unsigned char c : block)
+            sum += c;
+        block += static_cast<char>(-sum);
+        return block;
+    };
+    std::string fixed;
+
+    // "V\t3" became "V\t1". The only other byte that fits with bit 1 set again is the "A" at the end of the BMV
+    // line ("A" -> "C"), so the block must only be recovered when that "A" is not there. The value of VS is chosen
+    // so that bit 1 of the checksum byte is set, otherwise the checksum byte itself would be a candidate as well
+    // (the bytes of the VS line all have bit 1 set, so they are not candidates).
+    for (std::size_t length : {100, 300}) {
+        for (bool ambiguous : {false, true}) {
+            std::string sent;
+            for (const char *value : {"22", "23", "33"}) {
+                sent = make_block("V\t3\r\nBMV\t" + std::string(length, 'C') + (ambiguous ? "A" : "C") + "\r\nVS\t" + value);
+                if (sent.back() & 0x02)
+                    break;
+            }
+            std::string received = sent;
+            received[4] = '1';
+            // A line of 256 bytes or more isn't searched, so such a block is never recovered
+            bool expected = !ambiguous && length < 256;
+            bool recovered = recover_block(received, fixed);
+            if (recovered != expected || (recovered && fixed != sent)) {
+                std::cerr << "recovery: a block with a " << length + 5 << " byte line and " << (ambiguous ? "two candidates" : "one candidate")
+                          << (recovered ? " was recovered" : " was not recovered") << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cerr << "recovery: single candidates are recovered, ambiguous ones and long lines are not" << std::endl;
+    return true;
+}
+
+// parse_ttyUSB_link() replaced the regex of the original ttyusb2dev and must give the same physical address and device
+// name for every link: real looking sysfs links and uevent paths (hub chains, interfaces, other tty devices), hand
+// written malformed links and random strings of the characters and words that matter to both.
+static bool test_ttyusb() {
+    const std::regex pattern(R"(^.*/([0-9.-]+):.*?(ttyUSB[0-9]+)$)");
+    unsigned long links = 0, matched = 0;
+    auto check = [&](const std::string &link) {
+        std::string physical, device;
+        bool parsed = parse_ttyUSB_link(link, physical, device);
+        std::smatch matches;
+        bool regex = std::regex_search(link, matches, pattern);
+        if (parsed != regex || (parsed && (physical != matches[1] || device != matches[2]))) {
+            std::cerr << "ttyusb: \"" << escaped(link) << "\" gives " << (parsed ? physical + " " + device : "no match")
+                      << " and the regex " << (regex ? matches[1].str() + " " + matches[2].str() : "no match") << std::endl;
+            return false;
+        }
+        links++;
+        matched += parsed;
+        return true;
+    };
+
+    static constexpr const char *prefixes[] = {
+        "../../devices/platform/soc/3f980000.usb/usb1", "../../devices/pci0000:00/0000:00:14.0/usb3",
+        "/devices/platform/soc/fe980000.usb/usb1", "", "usb1",
+    };
+    static constexpr const char *chains[][4] = {
+        {"1-1", nullptr}, {"1-1", "1-1.4", nullptr}, {"1-1", "1-1.4", "1-1.4.2", nullptr}, {"3-2", "3-2.3", nullptr},
+        {"1-1", "1-1.1", "1-1.1.3", "1-1.1.3.7"}, {"2-10", nullptr},
+    };
+    static constexpr const char *interfaces[] = {":1.0", ":1.1", ":2.0", "", ":", ":x"};
+    static constexpr const char *tails[] = {
+        "/ttyUSB0/tty/ttyUSB0", "/ttyUSB12/tty/ttyUSB12", "/tty/ttyUSB3", "/ttyUSB0", "/ttyACM0/tty/ttyACM0",
+        "/ttyUSB/tty/ttyUSB", "/ttyUSB1/tty/ttyUSB1x", "/ttyS0", "ttyUSB4",
+    };
+    for (const char *prefix : prefixes) {
+        for (const auto &chain : chains) {
+            for (const char *interface : interfaces) {
+                for (const char *tail : tails) {
+                    std::string link = prefix;
+                    for (const char *hub : chain) {
+                        if (hub == nullptr)
+                            break;
+                        link += '/';
+                        link += hub;
+                    }
+                    link += interface;
+                    link += tail;
+                    if (!check(link))
+                        return false;
+                }
+            }
+        }
+    }
+
+    static constexpr const char *malformed[] = {
+        "", "/", "ttyUSB0", "/ttyUSB0", "/1-1:1.0", "/1-1:ttyUSB0", "1-1:1.0/ttyUSB0", "/:/ttyUSB0", "/-:ttyUSB0",
+        "/1-1.:ttyUSB0", "//1-1:1.0//ttyUSB0", "/1-1:1.0/ttyUSB0/", "/1-1 :1.0/ttyUSB0", "/1-1:1.0/ttyusb0",
+        "/1-1:1.0/TTYUSB0", "/1-1:1.0/ttyUSBttyUSB0", "/1-1:1.0/ttyUSB0ttyUSB1", "/a/1-1:/b/2-2:/ttyUSB9",
+        "/1-1:1.0/ttyUSB0\n", "\n/1-1:1.0/ttyUSB0", "/1-1:1.0/tty\rUSB0/ttyUSB0",
+    };
+    for (const char *link : malformed) {
+        if (!check(link))
+            return false;
+    }
+
+    // Random strings, the same sequence every run
+    static constexpr const char *words[] = {
+        "/", "1", "2", "-", ".", ":", "0", "9", "a", "/1-1", "/1-1.4", ":1.0", "ttyUSB", "ttyUSB0", "ttyACM", "usb1", "tty", "\n", "\r",
+    };
+    std::mt19937 random(1);
+    std::uniform_int_distribution<std::size_t> word(0, std::size(words) - 1), count(1, 14);
+    for (int i = 0; i < 200000; i++) {
+        std::string link;
+        for (std::size_t n = count(random); n > 0; n--)
+            link += words[word(random)];
+        if (i % 2 == 0)
+            link += "ttyUSB1";      // Most random strings don't end with a device name, so they would never match
+        if (!check(link))
+            return false;
+    }
+    std::cerr << "ttyusb: " << links << " links, " << matched << " with a physical address, parser and regex agree" << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    struct Test {
+        const char *name;
+        bool (*run)();
+    };
+    static constexpr Test tests[] = {
+        {"grammar", test_grammar},
+        {"allocations", test_allocations},
+        {"recovery", test_recovery},
+        {"ttyusb", test_ttyusb},
+    };
+
+    bool ran = false;
+    for (const auto &test : tests) {
+        if (argc > 1 && std::strcmp(argv[1], test.name) != 0)
+            continue;
+        ran = true;
+        if (!test.run()) {
+            std::cerr << "FAILED: " << test.name << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!ran) {
+        std::cerr << "Usage: " << argv[0] << " [ <test> ]" << std::endl;
+        std::cerr << "Tests:";
+        for (const auto &test : tests)
+            std::cerr << ' ' << test.name;
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// vicdecode: turn the binary output of vicread (--format=binary) back into the text output.
+// Usage: vicdecode [--time] [<file>]    (without a file, or with "-", the records are read from stdin)
+
+// C++ header files
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// C header files
+#include <cstring>
+#include <cerrno>
+
+// Linux header files
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vedirect.h"
+#include "vebinary.h"
+#include "vehex.h"
+
+struct DeviceInfo {
+    bool known = false;
+    bool labels = false;
+    std::string label;
+};
+
+int main(int argc, char *argv[])
+{
+    bool print_time = false;
+    const char *path = "-";
+    for (int argnr = 1; argnr < argc; argnr++) {
+        std::string_view arg = argv[argnr];
+        if (arg == "--time") {
+            print_time = true;
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Usage: " << argv[0] << " [--time] [<file>]" << std::endl;
+            std::cerr << "Prints the binary output of vicread (--format=binary) as text, from a file or stdin." << std::endl;
+            std::cerr << "  --time  Start every line with the wall-clock time of the block (ns since the epoch)" << std::endl;
+            return -1;
+        } else {
+            path = argv[argnr];
+        }
+    }
+
+    int fd = std::string_view(path) == "-" ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Error opening \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    std::vector<DeviceInfo> devices;
+    Aggregator window;
+    std::string buf;
+    std::string out;
+    std::size_t pos = 0;
+    unsigned long records = 0, skipped = 0;
+    bool ok = true;
+    for (;;) {
+        // Keep the unprocessed tail and read more behind it
+        buf.erase(0, pos);
+        pos = 0;
+        std::size_t old_size = buf.size();
+        buf.resize(old_size + 64 * 1024);
+        ssize_t n = read(fd, buf.data() + old_size, buf.size() - old_size);
+        if (n < 0 && errno == EINTR) {
+            buf.resize(old_size);
+            continue;
+        }
+        if (n < 0) {
+            std::cerr << "Error reading \"" << path << "\": " << std::strerror(errno) << std::endl;
+            ok = false;
+            break;
+        }
+        buf.resize(old_size + n);
+        if (n == 0)
+            break;
+
+        RecordHeader header;
+        while (std::size_t length = next_record(std::string_view(buf).substr(pos), header)) {
+            std::string_view record = std::string_view(buf).substr(pos, length);
+            pos += length;
+            records++;
+            if (header.version != binary_version) {
+                skipped++;
+                continue;
+            }
+            if (header.device_id >= devices.size())
+                devices.resize(header.device_id + 1);
+            DeviceInfo &dev = devices[header.device_id];
+
+            if (header.type == RecordType::Device && length > binary_header_size) {
+                dev.known = true;
+                dev.labels = record[binary_header_size] & 1;
+                dev.label = record.substr(binary_header_size + 1);
+            } else if (header.type == RecordType::Block || header.type == RecordType::Window || header.type == RecordType::Hex) {
+                if (!dev.known) {
+                    // Started in the middle of a stream, use the device id as label
+                    dev.known = true;
+                    dev.labels = true;
+                    dev.label = std::to_string(header.device_id);
+                }
+                std::int64_t monotonic_ns, realtime_ns;
+                auto print_line = [&](std::string_view name, std::string_view suffix, std::string_view value) {
+                    if (print_time) {
+                        out += std::to_string(realtime_ns);
+                        out += '\t';
+                    }
+                    if (dev.labels) {
+                        out += dev.label;
+                        out += '\t';
+                    }
+                    out += name;
+                    out += suffix;
+                    out += '\t';
+                    out += value;
+                    out += '\n';
+                };
+                out.clear();
+                bool valid;
+                if (header.type == RecordType::Block) {
+                    valid = decode_block_record(record, monotonic_ns, realtime_ns, [&](const DecodedField &field) {
+                        char value[32];
+                        print_line(field.name, {}, format_value(field, value));
+                    });
+                } else if (header.type == RecordType::Hex) {
+                    // A register update from a HEX-message (--hex)
+                    HexMessage message;
+                    valid = decode_hex_record(record, monotonic_ns, realtime_ns, message) && message.is_register();
+                    if (valid) {
+                        char name[16];
+                        char value[2 * hex_max_data + 3];
+                        print_line(format_register_name(message.reg(), name), {},
+                                   format_register_value(message.reg(), message.value(), message.value_size(), value));
+                    }
+                } else {
+                    // The summary of an aggregation window (--aggregate), stamped with the end of the window
+                    valid = decode_window_record(record, monotonic_ns, window);
+                    realtime_ns = window.end_ns;
+                    if (valid)
+                        for_each_summary_line(window, print_line);
+                }
+                if (!valid) {
+                    std::cerr << "Corrupt record " << records << ", skipped" << std::endl;
+                    skipped++;
+                    continue;
+                }
+                std::cout << out;
+            } else {
+                skipped++;
+            }
+        }
+    }
+    if (pos != buf.size()) {
+        std::cerr << "Incomplete record at the end of \"" << path << "\" (" << buf.size() - pos << " bytes)" << std::endl;
+        ok = false;
+    }
+    if (skipped > 0)
+        std::cerr << "Skipped " << skipped << " of " << records << " records" << std::endl;
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,272 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// vicemu: emulate a VE.Direct device on a pseudo terminal, to test vicread without hardware.
+// It sends a text frame every second (from the synthetic stream generator, vegen.h) and answers HEX Get commands
+// (vicread --poll) for the battery and panel registers. Replies can be delayed and lost on purpose.
+
+// C++ header files
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <random>
+#include <deque>
+
+// C header files
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+
+// Linux header files
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+
+#include "vedirect.h"
+#include "vehex.h"
+#include "vegen.h"
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void handleStop(int) {
+    stop_requested = 1;
+}
+
+// The value of a register in the current state of the generator. Returns false for an unknown register.
+static bool register_value(Generator const &generator, std::uint16_t reg, std::uint32_t &value, int &size) {
+    size = 2;
+    switch (reg) {
+    case 0xED8D:                        // Battery voltage, 0.01 V
+    case 0xEDD5:                        // Charger voltage, 0.01 V
+        value = generator.voltage() / 10;
+        return true;
+    case 0xED8F:                        // Battery current, 0.1 A
+        value = generator.current() / 100;
+        return true;
+    case 0xED8E:                        // Battery power, 1 W
+        value = generator.power();
+        return true;
+    case 0x0FFF:                        // State of charge, 0.01 %
+        value = generator.soc() * 10;
+        return true;
+    case 0xEEFF:                        // Consumed Ah, 0.1 Ah
+        value = generator.consumed() / 100;
+        size = 4;
+        return true;
+    case 0xEDBB:                        // Panel voltage, 0.01 V
+        value = generator.panel_voltage() / 10;
+        return true;
+    case 0xEDBC:                        // Panel power, 0.01 W
+        value = generator.panel_power() * 100;
+        size = 4;
+        return true;
+    }
+    return false;
+}
+
+struct Reply {
+    std::chrono::steady_clock::time_point due;
+    std::string text;
+};
+
+// The master is non-blocking: without a reader the buffer of the pseudo terminal fills up, and like a real device
+// the emulator then just sends into the void. Returns false on an error.
+static bool write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return true;
+        if (n <= 0)
+            return false;
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+static bool parse_option(std::string_view arg, std::string_view name, double &value) {
+    if (!arg.starts_with(name) || arg.size() == name.size())
+        return false;
+    value = std::strtod(std::string(arg.substr(name.size())).c_str(), nullptr);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorConfig config;
+    std::string profile = "bmv";
+    std::string link;
+    double interval_ms = 1000;
+    double delay_ms = 5;
+    double loss = 0;
+    double seed = 1;
+
+    for (int argnr = 1; argnr < argc; argnr++) {
+        std::string_view arg = argv[argnr];
+        if (parse_option(arg, "--interval=", interval_ms) || parse_option(arg, "--delay=", delay_ms) ||
+            parse_option(arg, "--loss=", loss) || parse_option(arg, "--seed=", seed) ||
+            parse_option(arg, "--hex-rate=", config.hex_rate) || parse_option(arg, "--bit-error-rate=", config.bit_error_rate)) {
+            continue;
+        } else if (arg.starts_with("--profile=")) {
+            profile = arg.substr(constexpr_strlen("--profile="));
+        } else if (arg.starts_with("--link=")) {
+            link = arg.substr(constexpr_strlen("--link="));
+        } else {
+            std::cerr << "This application emulates a VE.Direct device on a pseudo terminal, e.g. to test vicread --poll." << std::endl;
+            std::cerr << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [<options>]" << std::endl;
+            std::cerr << std::endl;
+            std::cerr << "Options:" << std::endl;
+            std::cerr << "  --profile=<profile>        mppt, shunt or bmv (default " << profile << ")" << std::endl;
+            std::cerr << "  --link=<path>              Also make a symlink to the pseudo terminal, e.g. /tmp/ttyVE" << std::endl;
+            std::cerr << "  --interval=<ms>            Time between the text frames (default " << interval_ms << ")" << std::endl;
+            std::cerr << "  --delay=<ms>               Time until a HEX Get is answered (default " << delay_ms << ")" << std::endl;
+            std::cerr << "  --loss=<p>                 Probability that a HEX Get isn't answered (default " << loss << ")" << std::endl;
+            std::cerr << "  --hex-rate=<p>             Probability per frame of an asynchronous HEX-message (default " << config.hex_rate << ")" << std::endl;
+            std::cerr << "  --bit-error-rate=<p>       Probability per byte of a bit flip in the text frames (default " << config.bit_error_rate << ")" << std::endl;
+            std::cerr << "  --seed=<n>                 Seed of the random generator (default " << seed << ")" << std::endl;
+            return -1;
+        }
+    }
+    if (profile == "mppt")
+        config.profile = Profile::Mppt;
+    else if (profile == "shunt")
+        config.profile = Profile::SmartShunt;
+    else if (profile == "bmv")
+        config.profile = Profile::Bmv;
+    else {
+        std::cerr << "Unknown profile: \"" << profile << "\"" << std::endl;
+        return -1;
+    }
+    config.seed = static_cast<unsigned>(seed);
+
+    if (signal(SIGINT, handleStop) == SIG_ERR || signal(SIGTERM, handleStop) == SIG_ERR) {
+        std::cerr << "Failed to set up signal handler for SIGINT/SIGTERM" << std::endl;
+        return -1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::cerr << "Error creating a pseudo terminal: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    std::string slave_path = ptsname(master);
+    // Keep the slave open ourselves: without it the master gets EIO between two vicread runs.
+    // Raw mode, otherwise the line discipline echoes the commands back and changes \n into \r\n.
+    int slave = open(slave_path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    struct termios tio;
+    if (slave == -1 || tcgetattr(slave, &tio) != 0) {
+        std::cerr << "Error opening \"" << slave_path << "\": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    if (!link.empty()) {
+        unlink(link.c_str());
+        if (symlink(slave_path.c_str(), link.c_str()) != 0) {
+            std::cerr << "Error creating the symlink \"" << link << "\": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+    std::cerr << "Emulating a " << profile << " on \"" << (link.empty() ? slave_path : link) << "\"" << std::endl;
+
+    Generator generator(config);
+    std::mt19937 rng(config.seed);
+    std::bernoulli_distribution lost(loss);
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(interval_ms));
+    auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(delay_ms));
+    auto next_frame = std::chrono::steady_clock::now();
+    std::deque<Reply> replies;          // In the order of the commands, all with the same delay
+    std::string commands;               // Received, up to the end of the last complete command
+    std::string frame;
+    unsigned long frames = 0, gets = 0, answered = 0;
+
+    while (!stop_requested) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_frame) {
+            frame.clear();
+            generator.next_block(frame);
+            if (!write_all(master, frame))
+                break;
+            frames++;
+            next_frame += interval;
+        }
+        while (!replies.empty() && now >= replies.front().due) {
+            if (!write_all(master, replies.front().text))
+                break;
+            replies.pop_front();
+            answered++;
+        }
+
+        auto wake = replies.empty() ? next_frame : std::min(next_frame, replies.front().due);
+        int timeout = std::max<long>(0, std::chrono::ceil<std::chrono::milliseconds>(wake - std::chrono::steady_clock::now()).count());
+        pollfd pfd{master, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) <= 0 || (pfd.revents & POLLIN) == 0)
+            continue;
+        char buf[256];
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n <= 0)
+            continue;
+        commands.append(buf, n);
+
+        // Every command is ":" <command> <data> <checksum> "\n"
+        for (std::size_t eol; (eol = commands.find('\n')) != std::string::npos; commands.erase(0, eol + 1)) {
+            auto start = commands.rfind(':', eol);
+            if (start == std::string::npos)
+                continue;
+            HexMessage command;
+            if (decode_hex_message(std::string_view(commands).substr(start, eol + 1 - start), command) != HexStatus::Valid)
+                continue;       // A real device ignores a command with a wrong checksum
+            Reply reply{std::chrono::steady_clock::now() + delay, {}};
+            if (command.command == static_cast<unsigned char>(HexCommand::Get) && command.size >= 2) {
+                gets++;
+                if (lost(rng))
+                    continue;
+                std::uint16_t reg = command.reg();
+                std::uint32_t value;
+                int size;
+                if (register_value(generator, reg, value, size))
+                    append_hex_message(reply.text, '7', reg, 0x00, value, size);
+                else
+                    append_hex_message(reply.text, '7', reg, hex_flag_unknown_id, 0, 0);
+            } else {
+                reply.text = ":352\n";  // Unknown command (0x3 + 0x52 = 0x55)
+            }
+            replies.push_back(std::move(reply));
+        }
+    }
+
+    std::cerr << "Sent " << frames << " frames, answered " << answered << " of " << gets << " Get commands" << std::endl;
+    if (!link.empty())
+        unlink(link.c_str());
+    close(slave);
+    close(master);
+    return 0;
+}
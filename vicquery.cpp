@@ -0,0 +1,212 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// vicquery: print the values in a time range from the store that vicread writes (vicread --store=<dir>).
+// The segment files are mapped into memory and only the parts that overlap the range are decoded: segments and
+// devices outside the range or without the requested fields are skipped on their footer index (the names are
+// sequence numbers, not times, so every segment is opened), and decoding
+// starts at the last checkpoint before the range (see vestore.h).
+
+// C++ header files
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+
+// C header files
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include "vedirect.h"
+#include "vebinary.h"
+#include "vestore.h"
+
+static std::int64_t clock_ns(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// A point in time: "now", relative to now (-<n>[s|m|h|d], e.g. -2h), seconds since the epoch or
+// local time (YYYY-MM-DD[THH:MM[:SS]]). Returns false if the text is none of these.
+static bool parse_time(std::string_view text, std::int64_t &ns) {
+    auto now = clock_ns(CLOCK_REALTIME);
+    if (text == "now") {
+        ns = now;
+        return true;
+    }
+    std::int64_t number;
+    auto res = std::from_chars(text.data() + text.starts_with('-'), text.data() + text.size(), number);
+    if (res.ec == std::errc() && text.starts_with('-')) {
+        std::string_view unit(res.ptr, text.data() + text.size() - res.ptr);
+        std::int64_t seconds = unit == "" || unit == "s" ? 1 : unit == "m" ? 60 : unit == "h" ? 3600 : unit == "d" ? 86400 : 0;
+        ns = now - number * seconds * 1'000'000'000;
+        return seconds != 0;
+    }
+    if (res.ec == std::errc() && res.ptr == text.data() + text.size()) {
+        ns = number * 1'000'000'000;
+        return true;
+    }
+    std::string copy(text);
+    for (const char *format : {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d"}) {
+        std::tm tm{};
+        const char *end = strptime(copy.c_str(), format, &tm);
+        if (end != nullptr && *end == '\0') {
+            tm.tm_isdst = -1;
+            ns = static_cast<std::int64_t>(std::mktime(&tm)) * 1'000'000'000;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void append_number(std::string &out, std::int64_t number) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), number);
+    out.append(buf, res.ptr - buf);
+}
+
+// Same as the CSV output of vicread
+static void append_csv_string(std::string &out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"')
+            out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+int main(int argc, char *argv[])
+{
+    std::int64_t from_ns = 0;
+    std::int64_t to_ns = clock_ns(CLOCK_REALTIME);
+    std::string device;
+    bool csv = false;
+    std::string dir;
+    FieldFilter filter;
+    for (int argnr = 1; argnr < argc; argnr++) {
+        std::string_view arg = argv[argnr];
+        if (arg.starts_with("--from=") || arg.starts_with("--to=")) {
+            bool from = arg.starts_with("--from=");
+            if (!parse_time(arg.substr(arg.find('=') + 1), from ? from_ns : to_ns)) {
+                std::cerr << "Invalid time: \"" << arg << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg.starts_with("--device=")) {
+            device = arg.substr(constexpr_strlen("--device="));
+        } else if (arg == "--csv") {
+            csv = true;
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Usage: " << argv[0] << " [--from=<time>] [--to=<time>] [--device=<label>] [--csv] <dir> [<white_list_filter>]" << std::endl;
+            std::cerr << "Prints the values in a time range from the store that vicread writes (vicread --store=<dir>)." << std::endl;
+            std::cerr << "Every line is <time_ns><tab><device><tab><name><tab><value>. Only number fields are stored." << std::endl;
+            std::cerr << "  --from=<time>     Start of the range (default: the beginning)" << std::endl;
+            std::cerr << "  --to=<time>       End of the range (default: now)" << std::endl;
+            std::cerr << "                    <time> is now, -<n>[s|m|h|d] before now, seconds since the epoch or" << std::endl;
+            std::cerr << "                    local time YYYY-MM-DD[THH:MM[:SS]]" << std::endl;
+            std::cerr << "  --device=<label>  Only this device" << std::endl;
+            std::cerr << "  --csv             CSV rows (time_ns,device,name,value) like vicread --format=csv" << std::endl;
+            return -1;
+        } else if (dir.empty()) {
+            dir = arg;
+        } else {
+            // Same as vicread: commas and/or spaces separate the names
+            while (!arg.empty()) {
+                auto sep = arg.find_first_of(", ");
+                if (sep != 0)
+                    filter.add(arg.substr(0, sep));
+                arg.remove_prefix(sep == std::string_view::npos ? arg.size() : sep + 1);
+            }
+        }
+    }
+    if (dir.empty()) {
+        std::cerr << "No store directory given, see " << argv[0] << " --help" << std::endl;
+        return -1;
+    }
+    std::bitset<8 * store_field_bytes> fields;
+    for (int id = 0; id < field_count; id++) {
+        Field field{};
+        field.id = id;
+        field.name = field_dictionary[id].label;
+        fields[id] = filter.accepts(field);
+    }
+
+    auto paths = store_segments(dir);
+    if (paths.empty()) {
+        std::cerr << "No segments in \"" << dir << "\"" << std::endl;
+        return -1;
+    }
+    std::string out;
+    if (csv)
+        out += "time_ns,device,name,value\n";
+    std::vector<StoredValue> values;
+    StoreSegment segment;
+    for (auto const &path : paths) {
+        if (!segment.open(path)) {
+            std::cerr << "Error opening \"" << path << "\": " << (errno == EINVAL ? "not a segment" : std::strerror(errno)) << std::endl;
+            continue;
+        }
+        values.clear();
+        for (auto const &[id, label] : segment.labels()) {
+            if (device.empty() || label == device)
+                segment.query(id, from_ns, to_ns, fields, [&values](StoredValue const &value) { values.push_back(value); });
+        }
+        // The devices are queried one by one, merge them in time order
+        std::stable_sort(values.begin(), values.end(), [](auto const &a, auto const &b) { return a.time_ns < b.time_ns; });
+        for (auto const &value : values) {
+            auto label = std::find_if(segment.labels().begin(), segment.labels().end(),
+                                      [&value](auto const &l) { return l.first == value.device_id; })->second;
+            auto field = stored_field(value);
+            append_number(out, value.time_ns);
+            out += csv ? ',' : '\t';
+            if (csv)
+                append_csv_string(out, label);
+            else
+                out += label;
+            out += csv ? ',' : '\t';
+            out += field.name;
+            out += csv ? ',' : '\t';
+            if (csv) {
+                append_number(out, field.number);
+            } else {
+                char buf[32];
+                out += format_value(field, buf);
+            }
+            out += '\n';
+            if (out.size() >= 64 * 1024) {
+                std::cout << out;
+                out.clear();
+            }
+        }
+    }
+    std::cout << out << std::flush;
+    return 0;
+}
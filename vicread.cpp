@@ -28,14 +28,26 @@
 // C++ header files
 #include <iostream>
 #include <iomanip>
-#include <regex>
+#include <sstream>
 #include <chrono>
+#include <array>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <semaphore>
+#include <bitset>
+#include <charconv>
 
 // C header files
 #include <cstdio>
 #include <cstring>
 #include <cassert>
 #include <cctype>
+#include <cmath>
 #include <cstdio>
 #include <csignal> // Add this header for signal handling
 
@@ -44,84 +56,21 @@
 #include <termios.h>
 #include <unistd.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
 
-#define constexpr_strlen(s) (sizeof(s) - 1) // The -1 is to exclude the null terminator
-
-// The VE.Direct protocol is described in the VE.Direct Protocol Specification
-// document. The document is available from Victron Energy.
-//
-// The grammer below is based on observations of 5 VE.Direct devices.
-// 1) SmartShunt 500A/50mV
-// 2) SmartSolar MPPT 150/85 rev2
-// 3) SmartSolar MPPT 150|70 rev2
-// 4) SmartSolar MPPT 100|50
-// 5) BMV-712 Smart - Battery monitor (BMV)
-//
-// THERE WILL BE DEVICES NOT MEETING THIS GRAMMAR!
-//
-// BNF Grammar:
-// <ve_direct_line> ::= <capitalized-name> <TAB> <number-value> <CRLF>
-//                   | <capitalized-name> <TAB> <hex-value> <CRLF>
-//                   | <capitalized-name> <TAB> "ON" <CRLF>
-//                   | <capitalized-name> <TAB> "OFF" <CRLF>
-//                   | <capitalized-name> <TAB> "---" <CRLF>
-//                   | "BMV" <TAB> <capitalized-string-value> <CRLF>
-//                   | "SER#" <TAB> <capitalized-string-value> <CRLF>
-//                   | "FWE" <TAB> <capitalized-string-value> <CRLF>
-//
-// <capitalized-name> ::= <uppercase-letter> <capitalized-name-rest>*
-// <capitalized-name-rest> ::= <uppercase-letter>
-//                          | <lowercase-letter>
-//                          | <digit>
-//
-// <capitalized-string-value> ::= <uppercase-letter> <capitalized-string-value-rest>*
-//                             | <digit> <capitalized-string-value-rest>*
-// <capitalized-string-value-rest> ::= <uppercase-letter>
-//                                  | <lowercase-letter>
-//                                  | <digit>
-//                                  | "/"
-//                                  | " "
-//
-// <TAB> ::= "\t"
-// <CRLF> ::= "\r\n"
-//
-// <number-value> ::= <signed-integer>
-// <signed-integer> ::= <digit>+
-//                   | "-" <digit>+
-//
-// <hex-value> ::= "0x" <hex-digit>+
-//
-// <uppercase-letter> ::= "A" | "B" | "C" | ... | "Z"
-// <lowercase-letter> ::= "a" | "b" | "c" | ... | "z"
-// <digit> ::= "0" | "1" | "2" | ... | "9"
-// <hex-digit> ::= <digit> | "A" | "B" | "C" | "D" | "E" | "F"
-
-
-// Regex pattern explanation:
-// ^ and $: Anchor the pattern to the start and end of the line.
-// (?: ...): Non-capturing group.
-// [A-Z][A-Za-z0-9]*: Matches a capitalized name.
-// \t: Matches a tab character.
-// (?:-?\d+|0x[A-F0-9]+|ON|OFF|---): Matches a number value, hex value, ON, OFF, or ---.
-// |: Alternation (OR) operator.
-// BMV: Matches the string "BMV".
-// SER#: Matches the string "SER#".
-// [A-Z][A-Za-z0-9/ ]*: Matches a capitalized string value.
-// \r\n: Matches a carriage return.
-//                                    1
-static std::regex ve_direct_line_regex(
-    "^(?:"
-        "(?:[A-Z][A-Za-z0-9]*\\t(?:-?[0-9]+|0x[A-F0-9]+|ON|OFF|---))"   // [A-Z][A-Za-z0-9]*: Matches a capitalized name. (?:-?\d+|0x[A-F0-9]+|ON|OFF|---): Matches a number value, hex value, ON, OFF, or ---.
-    "|"
-        "(?:BMV|SER#|FWE)\\t[A-Z0-9][A-Za-z0-9/ ]*"                     // BMV: Matches the string "BMV", "SER#"" or "FWE". [A-Z0-9][A-Za-z0-9/ ]*: Matches a capitalized string value.
-    ")\\r$"                                                             // Note that the \n is not included because reading a line on Linux discards the \n.
-);
-
-// Some statistics about the errors we encounter
-static unsigned int chksum_errors = 0;
-static unsigned int format_errors = 0;
-static unsigned int valid_blocks = 0;
-static unsigned long received_bytes = 0;   // This will take a while to overflow :-)
+#include "vedirect.h"
+#include "vebinary.h"
+#include "vehex.h"
+#include "veshm.h"
+#include "vestore.h"
+#include "veoutput.h"
+#include "vemetrics.h"
+#include "ttyusb.h"
+#include "vequeue.h"
 
 #include <chrono>
 #include <iomanip>
@@ -134,33 +83,1009 @@ void handleSIGPIPE(int signal) {
     exit(EXIT_SUCCESS);
 }
 
-static void print_error_info(std::string const &first_line) {
+// Set by SIGINT/SIGTERM: stop reading, write any buffered output and exit
+static volatile std::sig_atomic_t stop_requested = 0;
 
-    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
-    std::time_t timestamp = std::chrono::system_clock::to_time_t(now);
-    std::ostringstream oss;
-    oss << std::put_time(std::localtime(&timestamp), "%FT%T%z");
+void handleStop(int signal) {
+    (void)signal;
+    stop_requested = 1;
+}
+
+// Every thread has its own, the one of the main thread writes to stdout unless the pipeline (--threads) is used
+static thread_local OutputWriter output;
+
+// Format of the output on stdout (--format)
+static OutputFormat output_format = OutputFormat::Text;
+
+// Change-only output (--changes): only the fields that changed more than their deadband (--deadband) are sent,
+// and everything once per keyframe interval (--keyframe)
+static bool changes_only = false;
+static Deadbands deadbands{};
+static std::chrono::seconds keyframe_interval{0};
+
+// Latest-value table in shared memory for local readers (--shm), e.g. vicshm
+static ShmWriter shm;
+
+// Segmented time-series store (--store), queried with vicquery. The workers of --threads share it, hence the mutex.
+// storing is read without the mutex for every block; store_block checks store.is_open() again under the mutex.
+static StoreWriter store;
+static std::mutex store_mutex;
+static std::atomic<bool> storing{false};
+static constexpr std::size_t default_segment_mb = 16;
+
+// Windowed aggregation (--aggregate): instead of every block, one summary per field per window of this length
+static std::chrono::seconds aggregate_window{0};
+
+// Decode the HEX-messages into register events in the output (--hex), instead of only removing them
+static bool decode_hex = false;
+
+// Active polling (--poll): HEX Get commands for these registers, a round every poll_interval, with at most
+// poll_window Gets per device waiting for their reply. The replies are sent like the register events of --hex.
+static std::vector<std::uint16_t> poll_registers;
+static std::chrono::milliseconds poll_interval{200};
+static std::size_t poll_window = 2;
+static constexpr std::size_t max_poll_window = 16;      // A device only has a small receive buffer for commands
+static constexpr auto poll_timeout = std::chrono::milliseconds(500);
+
+// Repair a block with a checksum error when a single flipped bit explains it (--recover, see recover_block())
+static bool recover_errors = false;
+
+struct Worker;
+
+// A Get command that is waiting for its reply (--poll)
+struct PendingGet {
+    std::uint16_t reg;
+    std::chrono::steady_clock::time_point sent;
+};
+
+// Everything we keep per serial device, including some statistics about the errors we encounter.
+// With --threads the event loop owns the fd and the reconnect state, and a worker thread owns the rest.
+// Every counter is updated by one thread only, so the event loop can read them for the metrics.
+struct Device {
+    std::string path;                   // As given: e.g. /dev/ttyUSB0, ttyUSB0 or a physical USB address like 1-1.1.3
+    std::string device_path;            // The serial device path resolves to (the ttyUSB number can change on a reconnect)
+    std::string label;                  // Printed in front of every line when the labels are enabled
+    FieldFilter filter;                 // White list filter
+    bool replay = false;                // Replay of a raw capture (--replay) instead of a serial device
+    std::uint16_t id = 0;               // Index on the command line, identifies the device in the binary output
+    int fd = -1;
+    Worker *worker = nullptr;           // The worker thread that processes the data (--threads)
+    bool reset_pending = false;         // The worker still has to discard the data from before a disconnect
+
+    ChangeFilter changes;               // Last sent values, for --changes
+    std::chrono::steady_clock::time_point next_keyframe{};
+    Aggregator aggregator;              // Current window, for --aggregate
+
+    BlockParser parser;                 // The current block and HEX-message
+
+    Counter chksum_errors;
+    Counter format_errors;
+    Counter valid_blocks;
+    Counter recovered_blocks;           // Checksum errors repaired by --recover (not in valid_blocks)
+    Counter received_bytes;
+    Counter hex_messages;               // HEX-messages removed from the data
+    Counter hex_events;                 // Register events sent (--hex)
+    Counter hex_errors;                 // HEX-messages with a checksum error or in the wrong format (--hex)
+    Counter discarded_bytes;            // Thrown away while looking for a block end
+    Counter sent_fields;
+    Counter unchanged_fields;           // Not sent because of --changes
+    Counter reconnects;                 // Event loop
+    Counter dropped_bytes;              // Event loop: read while the queue to the worker was full (--threads)
+    Counter dropped_blocks;             // Not sent because the queue to the writer was full (--threads)
 
-    if (valid_blocks == 0) {
+    // Reconnect after a disconnect (read() returned 0 or an error)
+    std::chrono::steady_clock::time_point disconnected_at{};
+    std::chrono::steady_clock::time_point next_reconnect{};
+
+    // Latency and processing time (--metrics)
+    std::int64_t read_ns = 0;           // CLOCK_MONOTONIC of the last read() from the serial device
+    std::int64_t first_byte_ns = 0;     // CLOCK_MONOTONIC of the read() with the first byte of the current block
+    Histogram block_latency;            // From the first byte of a block until it has been sent (serial devices only)
+    Histogram parse_time;               // Per read(): the BlockParser checks and splits the blocks as the bytes arrive
+    Histogram validate_time;            // Per block: what is left after the parser (--recover)
+    Histogram output_time;
+
+    // Active polling (--poll)
+    std::vector<PendingGet> pending;    // Oldest first, at most poll_window
+    std::size_t next_register = 0;      // Index in poll_registers of the next Get of the current round
+    std::chrono::steady_clock::time_point next_round{};
+    Counter poll_requests;
+    Counter poll_responses;             // Replies that matched a pending Get
+    Counter poll_timeouts;              // No reply within poll_timeout
+    Counter poll_errors;                // Replies with an error flag (e.g. unknown register)
+    Counter poll_unmatched;             // Replies without a pending Get (e.g. after a timeout)
+    Counter poll_overruns;              // Gets skipped because the previous round hadn't finished
+    Histogram poll_latency;             // From the write() of a Get until its reply
+};
+
+// Print the device label in front of every line (when reading more than 1 device or when a label is given)
+static bool print_labels = false;
+
+// With --threads the workers and the event loop can all print messages
+static std::mutex stderr_mutex;
+
+static void print_error_info(Device const &dev, std::string const &first_line) {
+    std::lock_guard<std::mutex> lock(stderr_mutex);
+
+    std::time_t timestamp = std::time(nullptr);
+    std::tm local;
+    char time_text[32];
+    std::strftime(time_text, sizeof(time_text), "%FT%T%z", localtime_r(&timestamp, &local));
+    std::string prefix = time_text;
+    if (print_labels)
+        prefix += "] [" + dev.label;
+
+    if (dev.valid_blocks == 0) {
         // We only start counting the discarded blocks after we have received the first valid block
-        std::cerr   << "[" << oss.str() << "] " << first_line << " "
+        std::cerr   << "[" << prefix << "] " << first_line << " "
                     << "Waiting for first valid block. "
-                    << "Received bytes: " << received_bytes
+                    << "Received bytes: " << dev.received_bytes
                     << std::endl;
     } else {
-        unsigned int t = valid_blocks + chksum_errors + format_errors;
+        std::uint64_t t = dev.valid_blocks + dev.recovered_blocks + dev.chksum_errors + dev.format_errors;
         // Checksum error. Print message on stderr and continue with the next block
-        std::cerr   << "[" << oss.str() << "] " << first_line << " "
-                    << "Received bytes: " << received_bytes << ", "
+        std::cerr   << "[" << prefix << "] " << first_line << " "
+                    << "Received bytes: " << dev.received_bytes << ", "
                     << "total blocks: " << t << ", "
-                    << "valid blocks: " << valid_blocks << " (" << 100.0f * valid_blocks / t << "%), "
-                    << "checksum errors: " << chksum_errors << " (" << 100.0f * chksum_errors / t << "%), "
-                    << "format errors: " << format_errors << " (" << 100.0f * format_errors / t << "%)"
+                    << "valid blocks: " << dev.valid_blocks << " (" << 100.0f * dev.valid_blocks / t << "%), ";
+        if (recover_errors)
+            std::cerr << "recovered blocks: " << dev.recovered_blocks << " (" << 100.0f * dev.recovered_blocks / t << "%), ";
+        std::cerr   << "checksum errors: " << dev.chksum_errors << " (" << 100.0f * dev.chksum_errors / t << "%), "
+                    << "format errors: " << dev.format_errors << " (" << 100.0f * dev.format_errors / t << "%)"
                     << std::endl;
     }
     return;
 }
 
+// The filter list can be provided in different ways.
+// You can use commas and or spaces to separate the names. Using quotes is optional
+static FieldFilter make_filter(std::string_view names) {
+    FieldFilter filter;
+    while (!names.empty()) {
+        auto sep = names.find_first_of(", ");
+        if (sep != 0)
+            filter.add(names.substr(0, sep));
+        names.remove_prefix(sep == std::string_view::npos ? names.size() : sep + 1);
+    }
+    return filter;
+}
+
+// The text lines start with the label when reading more than 1 device or when a label is given
+static OutputDevice output_device_of(Device const &dev) {
+    return OutputDevice{dev.id, dev.label, print_labels};
+}
+
+// Write the announcement of a device, before any of its blocks
+static void print_device(Device const &dev) {
+    output_device(output, output_format, output_device_of(dev));
+}
+
+// Select the fields of a block that pass the white list filter and, with --changes, have changed
+static std::bitset<max_fields> select_fields(Device &dev, Fields const &fields) {
+    bool keyframe = false;
+    if (changes_only && keyframe_interval.count() > 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= dev.next_keyframe) {
+            keyframe = true;
+            dev.next_keyframe = now + keyframe_interval;
+        }
+    }
+
+    std::bitset<max_fields> selected;
+    for (std::size_t i = 0; i < fields.count; i++) {
+        auto const &field = fields.items[i];
+        if (!dev.filter.accepts(field))
+            continue;
+        if (changes_only && !dev.changes.changed(field, deadbands, keyframe)) {
+            dev.unchanged_fields++;
+            continue;
+        }
+        selected.set(i);
+    }
+    dev.sent_fields += selected.count();
+    return selected;
+}
+
+// Write the selected fields of a valid block in the selected output format
+static void print_block(Device &dev, Fields const &fields) {
+    auto selected = select_fields(dev, fields);
+    if (selected.none() && changes_only)
+        return;         // Nothing changed, nothing to send
+    auto accept = [&](Field const &field) { return selected.test(&field - fields.items.data()); };
+    output_block(output, output_format, output_device_of(dev), fields, accept);
+    if (!output.end_block())
+        dev.dropped_blocks++;
+}
+
+// Write the register update of a HEX-message in the selected output format, with the name "HEX:<register id>"
+static void print_hex(Device &dev, HexMessage const &message) {
+    output_hex(output, output_format, output_device_of(dev), message);
+    dev.hex_events++;
+    if (!output.end_block())
+        dev.dropped_blocks++;
+}
+
+// Send the Gets of the current round, as far as the outstanding window allows
+static void send_gets(Device &dev) {
+    while (dev.fd != -1 && dev.pending.size() < poll_window && dev.next_register < poll_registers.size()) {
+        char buf[hex_get_size];
+        auto get = format_hex_get(poll_registers[dev.next_register], buf);
+        if (write(dev.fd, get.data(), get.size()) != static_cast<ssize_t>(get.size()))
+            return;     // Try again with the next reply or round
+        dev.pending.push_back({poll_registers[dev.next_register], std::chrono::steady_clock::now()});
+        dev.next_register++;
+        dev.poll_requests++;
+    }
+}
+
+// Start a new round when it is time, and give up on the Gets that didn't get a reply in time
+static void poll_device(Device &dev) {
+    auto now = std::chrono::steady_clock::now();
+    auto expired = std::find_if(dev.pending.begin(), dev.pending.end(), [now](PendingGet const &get) { return now - get.sent < poll_timeout; });
+    dev.poll_timeouts += expired - dev.pending.begin();
+    dev.pending.erase(dev.pending.begin(), expired);
+    if (now >= dev.next_round) {
+        dev.poll_overruns += poll_registers.size() - dev.next_register;
+        dev.next_register = 0;
+        dev.next_round += poll_interval;
+        if (dev.next_round <= now)
+            dev.next_round = now + poll_interval;   // Don't try to catch up
+    }
+    send_gets(dev);
+}
+
+// A reply to a Get: match it with the oldest pending Get for the same register
+static void process_get_reply(Device &dev, HexMessage const &message) {
+    auto get = std::find_if(dev.pending.begin(), dev.pending.end(), [&](PendingGet const &get) { return get.reg == message.reg(); });
+    if (get == dev.pending.end()) {
+        dev.poll_unmatched++;
+    } else {
+        dev.poll_responses++;
+        dev.poll_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - get->sent).count());
+        dev.pending.erase(get);
+    }
+    if (message.flags() != 0)
+        dev.poll_errors++;
+    else
+        print_hex(dev, message);
+    send_gets(dev);
+}
+
+// A HEX-message that the parser has taken out of the data
+static void process_hex(Device &dev, std::string_view text) {
+    dev.hex_messages++;
+    if (!decode_hex && poll_registers.empty())
+        return;
+    HexMessage message;
+    switch (decode_hex_message(text, message)) {
+    case HexStatus::Valid:
+        break;
+    case HexStatus::ChecksumError:
+    case HexStatus::Malformed:
+        dev.hex_errors++;
+        return;
+    }
+    if (!message.is_register())
+        return;
+    if (static_cast<HexResponse>(message.command) == HexResponse::Get && !poll_registers.empty())
+        process_get_reply(dev, message);
+    else if (decode_hex && message.flags() == 0)    // Only without error flags the message carries a value
+        print_hex(dev, message);
+}
+
+// Write the summary of the current aggregation window of a device in the selected output format
+static void print_window(Device &dev) {
+    output_window(output, output_format, output_device_of(dev), dev.aggregator);
+    if (!output.end_block())
+        dev.dropped_blocks++;
+}
+
+// Start the aggregation window that contains wall-clock time now_ns. The windows are aligned to the clock
+// (e.g. a 60 s window starts on the minute), so the windows of all devices line up.
+static void start_window(Device &dev, std::int64_t now_ns) {
+    std::int64_t length = std::chrono::nanoseconds(aggregate_window).count();
+    std::int64_t start = now_ns - now_ns % length;
+    dev.aggregator.reset(start, start + length);
+}
+
+// Write the summary of the current window (if it has any values) and start the window that contains now_ns
+static void close_window(Device &dev, std::int64_t now_ns) {
+    if (!dev.aggregator.empty())
+        print_window(dev);
+    start_window(dev, now_ns);
+}
+
+// Write the summary of the (partial) current window when the program stops
+static void finish_window(Device &dev) {
+    if (aggregate_window.count() == 0 || dev.aggregator.empty())
+        return;
+    dev.aggregator.end_ns = std::min(dev.aggregator.end_ns, clock_ns(CLOCK_REALTIME));
+    print_window(dev);
+}
+
+static void aggregate_block(Device &dev, Fields const &fields) {
+    auto now = clock_ns(CLOCK_REALTIME);
+    if (now >= dev.aggregator.end_ns)
+        close_window(dev, now);
+    dev.aggregator.add(fields, [&dev](Field const &field) { return dev.filter.accepts(field); }, clock_ns(CLOCK_MONOTONIC));
+}
+
+// Append the block to the store. After a write error (e.g. a full disk) the store is closed and reading goes on.
+static void store_block(const Device &dev, const Fields &fields) {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (!store.is_open() || store.append(dev.id, fields, clock_ns(CLOCK_REALTIME)))
+        return;
+    std::string message = "ERROR writing the store: ";
+    message += std::strerror(errno);
+    message += ", storing stopped.";
+    print_error_info(dev, message);
+    storing.store(false, std::memory_order_relaxed);
+    store.close();
+}
+
+// Print one block, parsed and checked by the BlockParser of the device (or recovered here)
+static void process_block(Device &dev, const ParsedBlock &block) {
+    dev.received_bytes += block.size;
+
+    auto start_ns = clock_ns(CLOCK_MONOTONIC);
+    auto block_first_byte_ns = dev.first_byte_ns;
+    auto status = block.status;
+    const Fields *fields = &block.fields;
+    bool recovered = false;
+    if (status == BlockStatus::ChecksumError && recover_errors && dev.valid_blocks > 0 && block.complete) {
+        // Not before the first valid block: the first block is usually incomplete
+        thread_local std::string fixed;
+        thread_local Fields fixed_fields;
+        if (recover_block(block.text, fixed)) {
+            status = decode_fields(check_block(fixed).lines, fixed_fields) ? BlockStatus::Valid : BlockStatus::FormatErrorFields;
+            fields = &fixed_fields;
+            recovered = true;
+        }
+    }
+    auto validated_ns = clock_ns(CLOCK_MONOTONIC);
+    dev.validate_time.record(validated_ns - start_ns);
+    if (!dev.replay)
+        dev.first_byte_ns = dev.read_ns;     // The next block starts in the data of the last read()
+    switch (status) {
+    case BlockStatus::ChecksumError:
+        if (dev.valid_blocks > 0)
+            dev.chksum_errors++;
+        print_error_info(dev, "ERROR checksum, block discarded.");
+        return;
+    case BlockStatus::FormatErrorStart:
+        if (dev.valid_blocks > 0)
+            dev.format_errors++;
+        print_error_info(dev, "ERROR format, first 2 characters of block are not \\r\\n, block discarded.");
+        return;
+    case BlockStatus::FormatErrorLine: {
+        // Remove any \r characters in the line (it messes up the output)
+        std::string printable{block.bad_line};
+        printable.erase(std::remove(printable.begin(), printable.end(), '\r'), printable.end());
+        if (dev.valid_blocks > 0)
+            dev.format_errors++;
+        print_error_info(dev, "ERROR format, line \"" + printable + "\", block discarded.");
+        return;
+    }
+    case BlockStatus::FormatErrorFields:
+        if (dev.valid_blocks > 0)
+            dev.format_errors++;
+        print_error_info(dev, "ERROR format, too many fields, block discarded.");
+        return;
+    case BlockStatus::FormatErrorSize:
+        // No block end found in max_block_size bytes, this is garbage. Start all over again.
+        dev.discarded_bytes += block.size;
+        print_error_info(dev, "ERROR no block end found, " + std::to_string(block.size) + " bytes discarded.");
+        return;
+    case BlockStatus::Valid:
+        break;
+    }
+
+    if (recovered) {
+        dev.recovered_blocks++;
+        print_error_info(dev, "INFO checksum error, single bit flip repaired, block recovered.");
+    } else {
+        dev.valid_blocks++;
+    }
+    if (shm.is_open())
+        shm.publish(dev.id, *fields, clock_ns(CLOCK_REALTIME));
+    if (storing.load(std::memory_order_relaxed))
+        store_block(dev, *fields);
+    if (aggregate_window.count() > 0)
+        aggregate_block(dev, *fields);
+    else
+        print_block(dev, *fields);
+
+    auto sent_ns = clock_ns(CLOCK_MONOTONIC);
+    dev.output_time.record(sent_ns - validated_ns);
+    if (!dev.replay)
+        dev.block_latency.record(sent_ns - block_first_byte_ns);
+}
+
+// Parse the received bytes and process every complete block and HEX-message
+static void parse(Device &dev, const char *data, std::size_t size) {
+    auto start_ns = clock_ns(CLOCK_MONOTONIC);
+    dev.parser.feed(data, size, [&dev](const ParsedBlock &block) { process_block(dev, block); },
+                    [&dev](std::string_view text) { process_hex(dev, text); });
+    dev.parse_time.record(clock_ns(CLOCK_MONOTONIC) - start_ns);
+}
+
+// Open, lock and configure the serial device. Returns false (after printing the reason) on failure.
+static bool open_serial(Device &dev) {
+    dev.device_path = resolve_serial_device(dev.path);
+    if (dev.device_path.empty()) {
+        std::cerr << "Error opening the serial device \"" << dev.path << "\": " << std::strerror(ENOENT) << std::endl;
+        return false;
+    }
+    // Open the serial device in read only mode (read/write for --poll) and don't make it the controlling terminal
+    dev.fd = open(dev.device_path.c_str(), (poll_registers.empty() ? O_RDONLY : O_RDWR) | O_NOCTTY);
+    if (dev.fd == -1) {
+        std::cerr << "Error opening the serial device \"" << dev.path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Lock the serial device for exclusive access
+    if (flock(dev.fd, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "Error locking the serial device \"" << dev.path << "\": " << std::strerror(errno) << std::endl;
+        close(dev.fd);
+        dev.fd = -1;
+        return false;
+    }
+
+    // Serial port configuration for VE.Direct
+    struct termios tio;
+    memset(&tio, 0, sizeof(tio));
+    tio.c_cflag = CS8 | CREAD | CLOCAL;
+    tio.c_iflag = IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, B19200);
+    cfsetospeed(&tio, B19200);
+
+    tcflush(dev.fd, TCIFLUSH);
+    if (tcsetattr(dev.fd, TCSANOW, &tio) != 0) {
+        std::cerr << "Error configuring the serial device \"" << dev.path << "\": " << std::strerror(errno) << std::endl;
+        flock(dev.fd, LOCK_UN);
+        close(dev.fd);
+        dev.fd = -1;
+        return false;
+    }
+    return true;
+}
+
+static void close_serial(Device &dev) {
+    if (dev.fd == -1)
+        return;
+    flock(dev.fd, LOCK_UN);
+    close(dev.fd);
+    dev.fd = -1;
+}
+
+// Throw away the data that isn't a complete block (yet)
+static void discard_block(Device &dev) {
+    dev.received_bytes += dev.parser.pending();
+    dev.discarded_bytes += dev.parser.pending();
+    dev.parser.reset();
+}
+
+// The pipeline (--threads): the event loop only reads the serial devices, worker threads check, decode and format
+// the blocks, and a writer thread writes the output to stdout. They are connected by bounded lock-free SPSC queues,
+// so a slow stdout consumer can't delay the reads any more (and let the tty buffer of the kernel overflow).
+// When a queue is full the data is dropped and counted, the reads never wait.
+
+// From the event loop to a worker
+struct InputChunk {
+    enum class Kind : std::uint8_t {
+        Data,                           // Bytes read from the device
+        Reset,                          // The device was disconnected, discard its partial block
+        Tick                            // Close the aggregation windows that have ended (--aggregate)
+    };
+    static constexpr std::size_t capacity = 2048 - 24;
+
+    Kind kind;
+    std::uint32_t size;
+    Device *dev;
+    std::int64_t read_ns;               // CLOCK_MONOTONIC of the read()
+    char data[capacity];
+};
+
+struct Worker {
+    static constexpr std::size_t input_slots = 64;      // 128 KiB, more than 30 s of data of one device
+    static constexpr std::size_t output_slots = 256;    // 1 MiB
+
+    unsigned index = 0;
+    std::vector<Device *> devices;      // The devices this worker processes
+    SpscQueue<InputChunk> in{input_slots};
+    SpscQueue<OutputSlot> out{output_slots};
+    std::counting_semaphore<> ready{0}; // Released for every chunk in the queue
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+static std::vector<std::unique_ptr<Worker>> workers;
+static constexpr unsigned max_workers = 64;          // --threads; more workers than devices have nothing to do
+static std::counting_semaphore<> writer_ready{0};   // Released for every block in one of the output queues
+static std::atomic<bool> writer_stop{false};
+static std::thread writer_thread;
+
+// Hand a chunk without data to a worker. Returns false when its queue is full.
+static bool send_to_worker(Worker &worker, InputChunk::Kind kind, Device *dev) {
+    InputChunk *chunk = worker.in.reserve();
+    if (chunk == nullptr)
+        return false;
+    chunk->kind = kind;
+    chunk->size = 0;
+    chunk->dev = dev;
+    chunk->read_ns = 0;
+    worker.in.commit();
+    worker.ready.release();
+    return true;
+}
+
+// Retry interval for a disconnected device. Normally inotify reports the new device node much sooner.
+static constexpr auto reconnect_interval = std::chrono::seconds(1);
+
+// The device is gone (e.g. the USB adapter was unplugged). Close it and try to reconnect later. The statistics are kept.
+static void disconnect_serial(Device &dev, const char *reason) {
+    close_serial(dev);      // Also removes it from epoll
+    if (dev.worker != nullptr) {
+        // The parser belongs to the worker. Until it got the message the device isn't reconnected.
+        dev.reset_pending = !send_to_worker(*dev.worker, InputChunk::Kind::Reset, &dev);
+    } else {
+        discard_block(dev);
+    }
+    dev.disconnected_at = std::chrono::steady_clock::now();
+    dev.next_reconnect = dev.disconnected_at;
+    dev.pending.clear();                    // The replies are lost, start with a new round after the reconnect
+    dev.next_register = poll_registers.size();
+    print_error_info(dev, std::string("ERROR device disconnected (") + reason + "), trying to reconnect.");
+}
+
+// Try to open a disconnected device again. Returns true when it is back.
+static bool reconnect_serial(Device &dev, int epfd) {
+    auto now = std::chrono::steady_clock::now();
+    dev.next_reconnect = now + reconnect_interval;
+    if (dev.reset_pending) {
+        dev.reset_pending = !send_to_worker(*dev.worker, InputChunk::Kind::Reset, &dev);
+        if (dev.reset_pending)
+            return false;
+    }
+    // Quietly wait for the device to appear, only a device that exists but can't be opened is worth a message
+    if (resolve_serial_device(dev.path).empty() || !open_serial(dev))
+        return false;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &dev;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, dev.fd, &ev) != 0) {
+        std::cerr << "Error adding \"" << dev.path << "\" to epoll: " << std::strerror(errno) << std::endl;
+        close_serial(dev);
+        return false;
+    }
+    dev.reconnects++;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - dev.disconnected_at).count();
+    print_error_info(dev, "INFO device reconnected as \"" + dev.device_path + "\" after " + std::to_string(ms) + " ms.");
+    return true;
+}
+
+// Bookkeeping for the latency histogram, before the bytes of a read() are parsed
+static void mark_read(Device &dev, std::int64_t read_ns) {
+    dev.read_ns = read_ns;
+    if (dev.parser.pending() == 0)
+        dev.first_byte_ns = read_ns;
+}
+
+// Read whatever is available from the device and process all complete blocks.
+// With --threads the data is read directly into a free slot of the queue to the worker instead.
+static void read_device(Device &dev) {
+    InputChunk *chunk = nullptr;
+    char data[InputChunk::capacity];
+    char *buf = data;
+    if (dev.worker != nullptr) {
+        chunk = dev.worker->in.reserve();
+        if (chunk != nullptr)
+            buf = chunk->data;      // A full queue is still drained (into data), to keep the device going
+    }
+
+    ssize_t n = read(dev.fd, buf, InputChunk::capacity);    // The parser takes the bytes straight from here (or the queue)
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            return;
+        disconnect_serial(dev, n == 0 ? "end of file" : std::strerror(errno));
+        return;
+    }
+    if (dev.worker == nullptr) {
+        mark_read(dev, clock_ns(CLOCK_MONOTONIC));
+        parse(dev, data, n);
+    } else if (chunk == nullptr) {
+        dev.dropped_bytes += n;
+    } else {
+        chunk->kind = InputChunk::Kind::Data;
+        chunk->size = n;
+        chunk->dev = &dev;
+        chunk->read_ns = clock_ns(CLOCK_MONOTONIC);
+        dev.worker->in.commit();
+        dev.worker->ready.release();
+    }
+}
+
+static void process_chunk(Worker &worker, InputChunk &chunk) {
+    switch (chunk.kind) {
+    case InputChunk::Kind::Data: {
+        Device &dev = *chunk.dev;
+        mark_read(dev, chunk.read_ns);
+        parse(dev, chunk.data, chunk.size);
+        break;
+    }
+    case InputChunk::Kind::Reset:
+        discard_block(*chunk.dev);
+        break;
+    case InputChunk::Kind::Tick: {
+        auto now = clock_ns(CLOCK_REALTIME);
+        for (auto dev : worker.devices) {
+            if (now >= dev->aggregator.end_ns)
+                close_window(*dev, now);
+        }
+        break;
+    }
+    }
+}
+
+static void worker_main(Worker &worker) {
+    output.set_queue(&worker.out, &writer_ready);
+    for (;;) {
+        bool stopping = worker.stop.load(std::memory_order_acquire);
+        while (InputChunk *chunk = worker.in.front()) {
+            process_chunk(worker, *chunk);
+            worker.in.pop();
+        }
+        if (stopping)
+            break;
+        worker.ready.acquire();
+    }
+    for (auto dev : worker.devices)
+        finish_window(*dev);
+    output.flush();
+}
+
+// Collects the blocks of all workers. Under load the blocks are batched into large writes, with --flush=block the
+// output is written as soon as there is nothing more to collect.
+static void writer_main(FlushPolicy policy, std::chrono::milliseconds interval) {
+    output.set_policy(policy, interval);
+    for (;;) {
+        bool stopping = writer_stop.load(std::memory_order_acquire);
+        bool collected = false;
+        for (auto &worker : workers) {
+            while (OutputSlot *slot = worker->out.front()) {
+                output.append(std::string_view(slot->data, slot->size));
+                worker->out.pop();
+                collected = true;
+            }
+        }
+        if (collected)
+            continue;
+        if (policy == FlushPolicy::Block)
+            output.flush();
+        else
+            output.poll();
+        if (stopping)
+            break;
+        int timeout = output.timeout_ms();
+        if (timeout < 0)
+            writer_ready.acquire();
+        else
+            writer_ready.try_acquire_for(std::chrono::milliseconds(timeout));
+    }
+    output.flush();
+}
+
+// Start worker_count workers (each gets a share of the devices) and the writer thread
+static void start_pipeline(std::vector<std::unique_ptr<Device>> &devices, unsigned worker_count) {
+    output.flush();     // Anything written before the threads start (e.g. the CSV header)
+    worker_count = std::min<unsigned>(worker_count, devices.size());
+    for (unsigned i = 0; i < worker_count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->index = i;
+    }
+    for (std::size_t i = 0; i < devices.size(); i++) {
+        Worker &worker = *workers[i % worker_count];
+        worker.devices.push_back(devices[i].get());
+        devices[i]->worker = &worker;
+    }
+    for (auto &worker : workers)
+        worker->thread = std::thread(worker_main, std::ref(*worker));
+    writer_thread = std::thread(writer_main, output.policy(), output.interval());
+}
+
+// Let the workers process everything in their queue, then let the writer write everything
+static void stop_pipeline() {
+    for (auto &worker : workers) {
+        worker->stop.store(true, std::memory_order_release);
+        worker->ready.release();
+    }
+    for (auto &worker : workers)
+        worker->thread.join();
+    writer_stop.store(true, std::memory_order_release);
+    writer_ready.release();
+    writer_thread.join();
+}
+
+// With --realtime the replay is paced like a real device: 19200 baud, 8N1 is 10 bits per byte, so 1920 bytes per second
+static constexpr std::size_t realtime_chunk_size = 192;
+static constexpr auto realtime_chunk_interval = std::chrono::milliseconds(100);
+
+// Offline replay of a raw capture through exactly the same pipeline as a serial device.
+// A regular file is mapped in memory and parsed in place. Anything else (e.g. a pipe on stdin) is read until end of file.
+// Returns false (after printing the reason) on failure.
+static bool replay(Device &dev, bool realtime) {
+    dev.fd = dev.path == "-" ? STDIN_FILENO : open(dev.path.c_str(), O_RDONLY);
+    if (dev.fd == -1) {
+        std::cerr << "Error opening the replay file \"" << dev.path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto next_chunk = start_time;
+    unsigned long replayed_bytes = 0;
+    bool ok = true;
+
+    struct stat st;
+    if (fstat(dev.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        std::size_t size = st.st_size;
+        auto map = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, dev.fd, 0));
+        if (map == MAP_FAILED) {
+            std::cerr << "Error mapping the replay file \"" << dev.path << "\": " << std::strerror(errno) << std::endl;
+            close(dev.fd);
+            return false;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+
+        while (replayed_bytes < size && !stop_requested) {
+            std::size_t n = realtime ? std::min(size - replayed_bytes, realtime_chunk_size) : size;
+            parse(dev, map + replayed_bytes, n);
+            replayed_bytes += n;
+            if (realtime)
+                std::this_thread::sleep_until(next_chunk += realtime_chunk_interval);
+        }
+        munmap(map, size);
+    } else {
+        while (!stop_requested) {
+            char data[64 * 1024];
+            ssize_t n = read(dev.fd, data, realtime ? realtime_chunk_size : sizeof(data));
+            if (n == 0)
+                break;          // End of file
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "Error reading the replay file \"" << dev.path << "\": " << std::strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            replayed_bytes += n;
+            parse(dev, data, n);
+            if (realtime)
+                std::this_thread::sleep_until(next_chunk += realtime_chunk_interval);
+        }
+    }
+    if (dev.fd != STDIN_FILENO)
+        close(dev.fd);
+    dev.fd = -1;
+    finish_window(dev);
+    output.flush();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    print_error_info(dev, "INFO end of replay.");
+    if (changes_only)
+        std::cerr << "Sent " << dev.sent_fields << " fields, " << dev.unchanged_fields << " unchanged fields suppressed" << std::endl;
+    std::cerr << "Replayed " << replayed_bytes << " bytes from \"" << dev.path << "\" in " << elapsed.count() << " s ("
+              << replayed_bytes / elapsed.count() / 1e6 << " MB/s)" << std::endl;
+    return ok;
+}
+
+// Metrics in the Prometheus text format (--metrics)
+static MetricsEndpoint metrics;
+
+static std::string const &metrics_text(std::vector<std::unique_ptr<Device>> const &devices) {
+    struct Total {
+        const char *name;
+        const char *help;
+        Counter Device::*value;
+    };
+    static constexpr Total counters[] = {
+        {"vicread_received_bytes_total", "Bytes received from the device", &Device::received_bytes},
+        {"vicread_valid_blocks_total", "Blocks that passed the checksum and grammar checks", &Device::valid_blocks},
+        {"vicread_recovered_blocks_total", "Blocks with a checksum error repaired by --recover", &Device::recovered_blocks},
+        {"vicread_checksum_errors_total", "Blocks discarded because of a checksum error (after the first valid block)", &Device::chksum_errors},
+        {"vicread_format_errors_total", "Blocks discarded because of a format error (after the first valid block)", &Device::format_errors},
+        {"vicread_hex_messages_total", "HEX-messages removed from the data", &Device::hex_messages},
+        {"vicread_hex_events_total", "Register events decoded from HEX-messages and sent (--hex)", &Device::hex_events},
+        {"vicread_hex_errors_total", "HEX-messages with a checksum error or in the wrong format (--hex)", &Device::hex_errors},
+        {"vicread_discarded_bytes_total", "Bytes discarded while looking for a block end", &Device::discarded_bytes},
+        {"vicread_sent_fields_total", "Fields sent to stdout", &Device::sent_fields},
+        {"vicread_unchanged_fields_total", "Fields not sent because they didn't change (--changes)", &Device::unchanged_fields},
+        {"vicread_reconnects_total", "Reconnects after the device was disconnected", &Device::reconnects},
+        {"vicread_dropped_bytes_total", "Bytes dropped because the worker thread couldn't keep up (--threads)", &Device::dropped_bytes},
+        {"vicread_dropped_blocks_total", "Blocks dropped because the writer thread couldn't keep up (--threads)", &Device::dropped_blocks},
+        {"vicread_poll_requests_total", "HEX Get commands sent (--poll)", &Device::poll_requests},
+        {"vicread_poll_responses_total", "Replies that matched a Get command (--poll)", &Device::poll_responses},
+        {"vicread_poll_timeouts_total", "Get commands without a reply in time (--poll)", &Device::poll_timeouts},
+        {"vicread_poll_errors_total", "Replies with an error flag, e.g. an unknown register (--poll)", &Device::poll_errors},
+        {"vicread_poll_unmatched_total", "Replies without a pending Get command, e.g. after a timeout (--poll)", &Device::poll_unmatched},
+        {"vicread_poll_overruns_total", "Get commands skipped because the previous round hadn't finished (--poll)", &Device::poll_overruns},
+    };
+    struct Timing {
+        const char *stage;
+        Histogram Device::*histogram;
+    };
+    static constexpr Timing timings[] = {
+        {"parse", &Device::parse_time},
+        {"validate", &Device::validate_time},
+        {"output", &Device::output_time},
+    };
+
+    // Reused, so a scrape doesn't allocate once the text has reached its size
+    static std::string text;
+    text.clear();
+    for (auto const &counter : counters) {
+        append_prometheus_help(text, counter.name, "counter", counter.help);
+        for (auto const &dev : devices)
+            append_prometheus_sample(text, counter.name, prometheus_label("device", dev->label), (*dev).*counter.value);
+    }
+    append_prometheus_help(text, "vicread_block_latency_seconds", "histogram",
+                           "Time from the read() with the first byte of a block until the block has been sent");
+    for (auto const &dev : devices) {
+        if (!dev->replay)
+            dev->block_latency.append_prometheus(text, "vicread_block_latency_seconds", prometheus_label("device", dev->label));
+    }
+    append_prometheus_help(text, "vicread_stage_seconds", "histogram", "Processing time per stage: parse per read(), validate and output per block");
+    for (auto const &timing : timings) {
+        for (auto const &dev : devices) {
+            auto labels = prometheus_label("device", dev->label) + "," + prometheus_label("stage", timing.stage);
+            ((*dev).*timing.histogram).append_prometheus(text, "vicread_stage_seconds", labels);
+        }
+    }
+    if (!poll_registers.empty()) {
+        append_prometheus_help(text, "vicread_poll_latency_seconds", "histogram", "Time from a HEX Get command until its reply (--poll)");
+        for (auto const &dev : devices) {
+            if (!dev->replay)
+                dev->poll_latency.append_prometheus(text, "vicread_poll_latency_seconds", prometheus_label("device", dev->label));
+        }
+    }
+    if (!workers.empty()) {
+        append_prometheus_help(text, "vicread_queue_depth", "gauge", "Slots in use in the queues between the threads (--threads)");
+        for (auto const &worker : workers) {
+            auto label = prometheus_label("worker", std::to_string(worker->index));
+            append_prometheus_sample(text, "vicread_queue_depth", label + "," + prometheus_label("queue", "input"), worker->in.depth());
+            append_prometheus_sample(text, "vicread_queue_depth", label + "," + prometheus_label("queue", "output"), worker->out.depth());
+        }
+        append_prometheus_help(text, "vicread_queue_capacity", "gauge", "Slots in the queues between the threads (--threads)");
+        for (auto const &worker : workers) {
+            auto label = prometheus_label("worker", std::to_string(worker->index));
+            append_prometheus_sample(text, "vicread_queue_capacity", label + "," + prometheus_label("queue", "input"), worker->in.capacity());
+            append_prometheus_sample(text, "vicread_queue_capacity", label + "," + prometheus_label("queue", "output"), worker->out.capacity());
+        }
+    }
+    return text;
+}
+
+// The end of the current aggregation window (--aggregate with --threads): then the workers get a Tick
+static std::int64_t next_tick_ns = 0;
+
+static void schedule_tick(std::int64_t now_ns) {
+    std::int64_t length = std::chrono::nanoseconds(aggregate_window).count();
+    next_tick_ns = now_ns - now_ns % length + length;
+}
+
+// Milliseconds until the event loop must wake up: for the buffered output, the end of an aggregation window or
+// the metrics file, -1 if never
+
+static int wait_timeout_ms(std::vector<std::unique_ptr<Device>> const &devices) {
+    int timeout = output.timeout_ms();
+    int metrics_timeout = metrics.timeout_ms();
+    if (metrics_timeout != -1)
+        timeout = timeout == -1 ? metrics_timeout : std::min(timeout, metrics_timeout);
+    auto steady_now = std::chrono::steady_clock::now();
+    for (auto const &dev : devices) {
+        if (dev->fd == -1 && !dev->replay) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(dev->next_reconnect - steady_now).count();
+            int reconnect_timeout = std::max<long>(0, left);
+            timeout = timeout == -1 ? reconnect_timeout : std::min(timeout, reconnect_timeout);
+        }
+    }
+    if (!poll_registers.empty()) {
+        for (auto const &dev : devices) {
+            if (dev->fd == -1 || dev->replay)
+                continue;
+            auto next = dev->pending.empty() ? dev->next_round : std::min(dev->next_round, dev->pending.front().sent + poll_timeout);
+            int left = std::max<long>(0, std::chrono::ceil<std::chrono::milliseconds>(next - steady_now).count());
+            timeout = timeout == -1 ? left : std::min(timeout, left);
+        }
+    }
+    if (aggregate_window.count() > 0) {
+        auto now = clock_ns(CLOCK_REALTIME);
+        for (auto const &dev : devices) {
+            // With --threads the aggregator belongs to the worker, the windows all end at the next tick
+            auto end_ns = workers.empty() ? dev->aggregator.end_ns : next_tick_ns;
+            int left = std::max<std::int64_t>(0, (end_ns - now + 999999) / 1000000);
+            timeout = timeout == -1 ? left : std::min(timeout, left);
+        }
+    }
+    return timeout;
+}
+
+// Parse a decimal option value. Returns false if the text is not a number as a whole (e.g. "", "abc" or "16x").
+template <typename T>
+static bool parse_number(std::string_view text, T &value) {
+    auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && res.ec == std::errc() && res.ptr == text.data() + text.size();
+}
+
+// Parse the registers to poll (--poll), e.g. "0xED8D,0xED8F". Returns false (after printing the reason) on failure.
+static bool parse_registers(std::string_view list) {
+    while (!list.empty()) {
+        auto item = list.substr(0, list.find(','));
+        list.remove_prefix(std::min(list.size(), item.size() + 1));
+        auto digits = item.starts_with("0x") || item.starts_with("0X") ? item.substr(2) : item;
+        std::uint16_t reg;
+        auto res = std::from_chars(digits.data(), digits.data() + digits.size(), reg, 16);
+        if (digits.empty() || res.ec != std::errc() || res.ptr != digits.data() + digits.size()) {
+            std::cerr << "Invalid register: \"" << item << "\"" << std::endl;
+            return false;
+        }
+        poll_registers.push_back(reg);
+    }
+    return true;
+}
+
+// Print the response rate and latency of the polling (--poll) at the end
+static void print_poll_statistics(Device const &dev) {
+    std::uint64_t requests = dev.poll_requests;
+    std::uint64_t responses = dev.poll_responses;
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2)
+         << "INFO polling: " << requests << " Gets, " << responses << " replies ("
+         << (requests ? 100.0 * responses / requests : 0.0) << "%), "
+         << dev.poll_timeouts << " timeouts, " << dev.poll_errors << " errors, " << dev.poll_unmatched << " unmatched, "
+         << dev.poll_overruns << " overruns, mean latency "
+         << (responses ? dev.poll_latency.sum_ns() / 1e6 / responses : 0.0) << " ms.";
+    print_error_info(dev, text.str());
+}
+
+// Parse the deadbands (--deadband), e.g. "V:20,P:5,SOC:1%". Returns false (after printing the reason) on failure.
+static bool parse_deadbands(std::string_view list) {
+    while (!list.empty()) {
+        auto item = list.substr(0, list.find(','));
+        list.remove_prefix(std::min(list.size(), item.size() + 1));
+        auto colon = item.find(':');
+        int id = lookup_field(item.substr(0, colon));
+        if (colon == std::string_view::npos || id == unknown_field) {
+            std::cerr << "Invalid deadband: \"" << item << "\" (expected <name>:<value>[%] with a known field name)" << std::endl;
+            return false;
+        }
+        auto value = item.substr(colon + 1);
+        bool relative = value.ends_with('%');
+        if (relative)
+            value.remove_suffix(1);
+        double number = 0.0;
+        auto res = std::from_chars(value.data(), value.data() + value.size(), number);
+        if (value.empty() || res.ec != std::errc() || res.ptr != value.data() + value.size() || number < 0) {
+            std::cerr << "Invalid deadband value: \"" << item << "\"" << std::endl;
+            return false;
+        }
+        // The values of the protocol are whole numbers (e.g. mV), so a fraction of a unit can't be meant
+        if (!relative && (number != std::floor(number) || number >= 0x1p62)) {
+            std::cerr << "Invalid deadband value: \"" << item << "\" (a whole number in the units of the protocol, e.g. V:20 is 20 mV)" << std::endl;
+            return false;
+        }
+        if (relative)
+            deadbands[id].relative = number / 100.0;
+        else
+            deadbands[id].absolute = static_cast<std::int64_t>(number);
+    }
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -169,188 +1094,449 @@ int main(int argc, char *argv[])
         std::cerr << "Failed to set up signal handler for SIGPIPE" << std::endl;
         return -1;
     }
+    if (signal(SIGINT, handleStop) == SIG_ERR || signal(SIGTERM, handleStop) == SIG_ERR) {
+        std::cerr << "Failed to set up signal handler for SIGINT/SIGTERM" << std::endl;
+        return -1;
+    }
     // Set the precision of the floating point numbers
     std::cerr << std::fixed << std::setprecision(2);
 
-    if (argc < 2) {
+    // Options start with "--". Without --device, the first other argument is the serial device and
+    // all remaining arguments form the white list filter
+    std::vector<std::unique_ptr<Device>> devices;
+    std::vector<char *> args;
+    bool realtime = false;
+    std::string shm_name;
+    std::string store_dir;
+    std::size_t segment_mb = default_segment_mb;
+    unsigned thread_count = 0;
+    for (int argnr = 1; argnr < argc; argnr++) {
+        std::string_view arg = argv[argnr];
+        if (arg == "--regex-validator") {
+            use_regex_validator = true;
+        } else if (arg == "--hex") {
+            decode_hex = true;
+        } else if (arg == "--recover") {
+            recover_errors = true;
+        } else if (arg == "--poll" || arg.starts_with("--poll=")) {
+            // --poll[=<register>,...], default the battery voltage, current and power
+            if (!parse_registers(arg == "--poll" ? "0xED8D,0xED8F,0xED8E" : arg.substr(constexpr_strlen("--poll="))))
+                return -1;
+        } else if (arg.starts_with("--poll-interval=")) {
+            long ms = 0;
+            if (!parse_number(arg.substr(constexpr_strlen("--poll-interval=")), ms) || ms <= 0) {
+                std::cerr << "Invalid poll interval: \"" << arg.substr(constexpr_strlen("--poll-interval=")) << "\"" << std::endl;
+                return -1;
+            }
+            poll_interval = std::chrono::milliseconds(ms);
+        } else if (arg.starts_with("--poll-window=")) {
+            if (!parse_number(arg.substr(constexpr_strlen("--poll-window=")), poll_window) || poll_window == 0 || poll_window > max_poll_window) {
+                std::cerr << "Invalid poll window: \"" << arg.substr(constexpr_strlen("--poll-window=")) << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg == "--threads" || arg.starts_with("--threads=")) {
+            // --threads[=<workers>]
+            thread_count = 1;
+            if (arg != "--threads" && (!parse_number(arg.substr(constexpr_strlen("--threads=")), thread_count) ||
+                                       thread_count == 0 || thread_count > max_workers)) {
+                std::cerr << "Invalid number of threads: \"" << arg.substr(constexpr_strlen("--threads=")) << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg.starts_with("--flush=")) {
+            // --flush=block|interval:<ms>|none
+            auto policy = arg.substr(constexpr_strlen("--flush="));
+            if (policy == "block") {
+                output.set_policy(FlushPolicy::Block, {});
+            } else if (policy == "none") {
+                output.set_policy(FlushPolicy::None, {});
+            } else if (long ms = 0; policy.starts_with("interval:") && parse_number(policy.substr(constexpr_strlen("interval:")), ms) && ms > 0) {
+                output.set_policy(FlushPolicy::Interval, std::chrono::milliseconds(ms));
+            } else {
+                std::cerr << "Invalid flush policy: \"" << policy << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg.starts_with("--format=")) {
+            auto format = arg.substr(constexpr_strlen("--format="));
+            if (format == "text") {
+                output_format = OutputFormat::Text;
+            } else if (format == "binary") {
+                output_format = OutputFormat::Binary;
+            } else if (format == "csv") {
+                output_format = OutputFormat::Csv;
+            } else if (format == "jsonl") {
+                output_format = OutputFormat::Jsonl;
+            } else {
+                std::cerr << "Invalid output format: \"" << format << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg == "--changes") {
+            changes_only = true;
+        } else if (arg.starts_with("--deadband=")) {
+            // --deadband=<name>:<value>[%],... e.g. V:20,P:5,SOC:1%
+            if (!parse_deadbands(arg.substr(constexpr_strlen("--deadband="))))
+                return -1;
+        } else if (arg.starts_with("--keyframe=")) {
+            long seconds = 0;
+            if (!parse_number(arg.substr(constexpr_strlen("--keyframe=")), seconds) || seconds < 0) {
+                std::cerr << "Invalid keyframe interval: \"" << arg.substr(constexpr_strlen("--keyframe=")) << "\"" << std::endl;
+                return -1;
+            }
+            keyframe_interval = std::chrono::seconds(seconds);
+        } else if (arg.starts_with("--aggregate=")) {
+            long seconds = 0;
+            if (!parse_number(arg.substr(constexpr_strlen("--aggregate=")), seconds) || seconds <= 0) {
+                std::cerr << "Invalid aggregation window: \"" << arg << "\"" << std::endl;
+                return -1;
+            }
+            aggregate_window = std::chrono::seconds(seconds);
+        } else if (arg.starts_with("--shm=")) {
+            shm_name = arg.substr(constexpr_strlen("--shm="));
+            if (!shm_name.starts_with('/'))
+                shm_name.insert(0, "/");
+        } else if (arg.starts_with("--store=")) {
+            // --store=<dir>[,<segment MB>]
+            store_dir = arg.substr(constexpr_strlen("--store="));
+            auto comma = store_dir.find(',');
+            bool valid = true;
+            if (comma != std::string::npos) {
+                valid = parse_number(std::string_view(store_dir).substr(comma + 1), segment_mb);
+                store_dir.erase(comma);
+            }
+            if (!valid || store_dir.empty() || segment_mb == 0 || segment_mb > 4095) {
+                std::cerr << "Invalid store: \"" << arg << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg.starts_with("--metrics=")) {
+            if (!metrics.open(arg.substr(constexpr_strlen("--metrics=")))) {
+                std::cerr << "Error setting up the metrics \"" << arg << "\": " << std::strerror(errno) << std::endl;
+                return -1;
+            }
+        } else if (arg == "--realtime") {
+            realtime = true;
+        } else if (arg.starts_with("--device=") || arg.starts_with("--replay=")) {
+            // --device=<serial_device>[,<label>] or --replay=<file>[,<label>]
+            bool is_replay = arg.starts_with("--replay=");
+            if (!devices.empty() && devices.front()->replay != is_replay) {
+                std::cerr << "Options --device and --replay cannot be combined" << std::endl;
+                return -1;
+            }
+            auto spec = arg.substr(arg.find('=') + 1);
+            auto comma = spec.find(',');
+            auto dev = std::make_unique<Device>();
+            dev->path = spec.substr(0, comma);
+            dev->replay = is_replay;
+            if (comma != std::string_view::npos) {
+                dev->label = spec.substr(comma + 1);
+                print_labels = true;
+            }
+            devices.push_back(std::move(dev));
+        } else if (arg.starts_with("--filter=")) {
+            if (devices.empty()) {
+                std::cerr << "Option --filter must follow a --device or --replay option" << std::endl;
+                return -1;
+            }
+            devices.back()->filter = make_filter(arg.substr(constexpr_strlen("--filter=")));
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Unknown option: \"" << arg << "\"" << std::endl;
+            return -1;
+        } else {
+            args.push_back(argv[argnr]);
+        }
+    }
+
+    if (!args.empty() && !devices.empty() && devices.front()->replay) {
+        // When replaying, all other arguments form the white list filter for the replays without a --filter
+        std::string names;
+        for (auto arg : args) {
+            names += arg;
+            names += ',';
+        }
+        for (auto &dev : devices) {
+            if (dev->filter.all)
+                dev->filter = make_filter(names);
+        }
+    } else if (!args.empty()) {
+        auto dev = std::make_unique<Device>();
+        dev->path = args[0];
+        std::string names;
+        for (std::size_t argnr = 1; argnr < args.size(); argnr++) {
+            names += args[argnr];
+            names += ',';
+        }
+        dev->filter = make_filter(names);
+        devices.insert(devices.begin(), std::move(dev));
+    }
+
+    if (devices.empty()) {
         std::cerr << "This application reads the VE.Direct protocol from a serial device and prints the data to stdout." << std::endl;
         std::cerr << "All error and information messages are sent to stderr." << std::endl;
         std::cerr << "The VE.Direct protocol is used by Victron Energy devices to communicate with a host computer." << std::endl;
         std::cerr << std::endl;
-        std::cerr << "Usage: " << argv[0] << " <serial_device> [<white_list_filter>]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [<options>] <serial_device> [<white_list_filter>]" << std::endl;
+        std::cerr << "       " << argv[0] << " [<options>] --device=<serial_device>[,<label>] [--filter=<white_list_filter>] ..." << std::endl;
+        std::cerr << "       " << argv[0] << " [<options>] --replay=<file>[,<label>] [--filter=<white_list_filter>] ... [<white_list_filter>]" << std::endl;
         std::cerr << std::endl;
         std::cerr << "The serial device is typically a USB to serial adapter (e.g. /dev/ttyUSB0) connected to the VE.Direct port on the device." << std::endl;
         std::cerr << "The white list filter is list of field names (e.g. \"P,SOC\" or \"P SOC\") that will be printed on stdout." << std::endl;
         std::cerr << "You can use commas and/or spaces to separate the names. Quotes are optional." << std::endl;
         std::cerr << "The names in the filter are case sensitive. If no filter is specified, all fields are printed." << std::endl;
         std::cerr << std::endl;
+        std::cerr << "Multiple devices are read by one process with repeated --device options, each followed by its own --filter." << std::endl;
+        std::cerr << "When reading multiple devices, or when a label is given, each line on stdout starts with the label of the device and a tab." << std::endl;
+        std::cerr << "The default label is the serial device name." << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "A raw capture of the serial data (e.g. made with \"cat /dev/ttyUSB0 > capture.raw\") can be replayed with --replay." << std::endl;
+        std::cerr << "It runs through exactly the same checks and filter and the program stops at the end of the file(s)." << std::endl;
+        std::cerr << std::endl;
         std::cerr << "Any block with a checksum error will be discarded." << std::endl;
         std::cerr << "As the checksum coverage isn't very strong an additional layer of checking has been added based on the grammar" << std::endl;
         std::cerr << "Any lines that don't meet the expected format/grammer will result in a discard of the current block" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --device=<serial_device>[,<label>]  Read (also) from this serial device" << std::endl;
+        std::cerr << "  --replay=<file>[,<label>]           Replay a raw capture (\"-\" is stdin) as fast as possible instead of reading a serial device" << std::endl;
+        std::cerr << "  --realtime                          Replay at the speed of a real device (19200 baud)" << std::endl;
+        std::cerr << "  --filter=<white_list_filter>        White list filter for the preceding --device or --replay" << std::endl;
+        std::cerr << "  --format=text|binary|csv|jsonl      Output format: <name><tab><value> lines (default), length-prefixed binary" << std::endl;
+        std::cerr << "                                      records (see vebinary.h, vicdecode turns them back into text)," << std::endl;
+        std::cerr << "                                      CSV rows (time_ns,device,name,value) or one JSON object per block" << std::endl;
+        std::cerr << "  --changes                           Only send the fields that changed since they were last sent" << std::endl;
+        std::cerr << "  --deadband=<name>:<value>[%],...    With --changes, ignore changes up to this whole number (in the units of the protocol," << std::endl;
+        std::cerr << "                                      e.g. V:20 is 20 mV) or percentage of the last sent value (e.g. SOC:1%)" << std::endl;
+        std::cerr << "  --keyframe=<s>                      With --changes, send all fields every <s> seconds" << std::endl;
+        std::cerr << "  --aggregate=<s>                     Instead of every block, send count, mean, min, max and last of every" << std::endl;
+        std::cerr << "                                      number field per window of <s> seconds, plus the energy from P (P_mWh)" << std::endl;
+        std::cerr << "  --shm=<name>                        Also publish the last value of every field in POSIX shared memory" << std::endl;
+        std::cerr << "                                      (/dev/shm/<name>), for any number of local readers (see vicshm)" << std::endl;
+        std::cerr << "  --store=<dir>[,<MB>]                Also append the number fields of every block to a time-series store in <dir>," << std::endl;
+        std::cerr << "                                      in segment files of at most <MB> MB (default 16), queried with vicquery" << std::endl;
+        std::cerr << "  --metrics=<endpoint>                Counters and latency histograms in the Prometheus text format on" << std::endl;
+        std::cerr << "                                      unix:<path>, tcp:[<address>:]<port> (default address 127.0.0.1)" << std::endl;
+        std::cerr << "                                      or file:<path>[,<s>] (written every <s> seconds, default 10)" << std::endl;
+        std::cerr << "  --flush=block|interval:<ms>|none    When to write the output to stdout: after every block (default)," << std::endl;
+        std::cerr << "                                      at most once per interval, or only when the output buffer is full" << std::endl;
+        std::cerr << "  --threads[=<n>]                     Check, decode and write the blocks on <n> worker threads (default 1, at most" << std::endl;
+        std::cerr << "                                      64) and a writer thread, so a slow stdout can't delay the reads (dropped data is" << std::endl;
+        std::cerr << "                                      counted)" << std::endl;
+        std::cerr << "  --hex                               Send the register updates in the asynchronous HEX-messages as well, as" << std::endl;
+        std::cerr << "                                      HEX:<register id> (e.g. HEX:0xED8D) with the value in the units of the register" << std::endl;
+        std::cerr << "  --poll[=<register>,...]             Open the serial devices read/write and ask for these registers (default" << std::endl;
+        std::cerr << "                                      0xED8D,0xED8F,0xED8E: battery voltage, current and power) with HEX Get" << std::endl;
+        std::cerr << "                                      commands; the replies are sent like --hex (between the text frames)" << std::endl;
+        std::cerr << "  --poll-interval=<ms>                Time between the rounds of Get commands (default 200)" << std::endl;
+        std::cerr << "  --poll-window=<n>                   Get commands per device that may wait for a reply (default 2, at most 16)" << std::endl;
+        std::cerr << "  --recover                           Repair a block with a checksum error when exactly one flipped bit makes it" << std::endl;
+        std::cerr << "                                      pass the checksum and the grammar (counted as recovered blocks)" << std::endl;
+        std::cerr << "  --regex-validator                   Check the grammar with std::regex instead of the (much faster) table driven validator" << std::endl;
         return -1;
     }
 
-    // The filter list can be provided in different ways.
-    // You can use commas and or spaces to separate the names. Using quotes is optional
-    std::string filter{','};        // Default to no white list filter
-    {
-        // Add all arguments to the filter list
-        int argnr = 2;
-        while (argnr < argc) {
-            filter += argv[argnr++];
-            filter += ',';
-        }
-        // Now do some cleanup of the list. We want to replace all spaces with commas and remove any consecutive commas
-        std::replace(filter.begin(), filter.end(), ' ', ',');
-        filter.erase(std::unique(filter.begin(), filter.end(), [](char a, char b) { return a == ',' && b == ','; }), filter.end());
+    if (changes_only && aggregate_window.count() > 0) {
+        std::cerr << "Options --changes and --aggregate cannot be combined" << std::endl;
+        return -1;
     }
-    if (filter == ",") {
-        std::cerr << "No white list filter used" << std::endl;
-        filter.clear();
-    } else {
-        std::cerr << "Using white list filter: \"" << filter.substr(1, filter.size() - 2) << "\"" << std::endl;
+    if (!poll_registers.empty() && thread_count > 0) {
+        // The Gets are sent by the event loop and their replies are matched on the worker thread
+        std::cerr << "Options --poll and --threads cannot be combined" << std::endl;
+        return -1;
     }
+    for (auto &dev : devices)
+        dev->next_register = poll_registers.size();     // No round before the first poll_device()
+    if (devices.size() > 1)
+        print_labels = true;
+    if (use_regex_validator)
+        std::cerr << "Using regex validator" << std::endl;
 
-
-    // Print serial device name with double quotes.
-    std::cerr << "Using serial device: \"" << argv[1] << "\"" << std::endl;
-
-    int fd;
-    fd = open(argv[1], O_RDONLY | O_NOCTTY );   // Open the serial device in read only mode and don't make it the controlling terminal
-    if (fd == -1) {
-        std::cerr << "Error opening the serial device: " << std::strerror(errno) << std::endl;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) {
+        std::cerr << "Error creating epoll instance: " << std::strerror(errno) << std::endl;
         return -1;
     }
 
-    // Lock the serial device for exclusive access
-    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
-        std::cerr << "Error locking the serial device: " << std::strerror(errno) << std::endl;
-        close(fd);
+    if (devices.size() > 0xFFFF) {
+        std::cerr << "Too many devices" << std::endl;
         return -1;
     }
+    if (output_format == OutputFormat::Csv)
+        output.append("time_ns,device,name,value\n");
 
-    // Serial port configuration for VE.Direct
-    {
-        struct termios tio;
-        memset(&tio, 0, sizeof(tio));
-        tio.c_cflag = CS8 | CREAD | CLOCAL;
-        tio.c_iflag = IGNPAR;
-        tio.c_oflag = 0;
-        tio.c_lflag = 0;
-        tio.c_cc[VMIN] = 1;
-        tio.c_cc[VTIME] = 0;
-        cfsetispeed(&tio, B19200);
-        cfsetospeed(&tio, B19200);
-
-        tcflush(fd, TCIFLUSH);
-        if (tcsetattr(fd, TCSANOW, &tio) != 0) {
-            std::cerr << "Error configuring the serial device: " << std::strerror(errno) << std::endl;
-            flock(fd, LOCK_UN);
-            close(fd);
+    std::vector<std::string_view> labels;
+    for (std::size_t i = 0; i < devices.size(); i++) {
+        devices[i]->id = i;
+        if (devices[i]->label.empty())
+            devices[i]->label = devices[i]->path;
+        labels.push_back(devices[i]->label);
+    }
+    if (!shm_name.empty()) {
+        if (!shm.create(shm_name, labels)) {
+            std::cerr << "Error creating the shared memory \"" << shm_name << "\": " << std::strerror(errno) << std::endl;
             return -1;
         }
+        std::cerr << "Publishing the last values in shared memory \"" << shm_name << "\"" << std::endl;
+    }
+    if (!store_dir.empty()) {
+        if (!store.open(store_dir, labels, segment_mb << 20)) {
+            std::cerr << "Error opening the store \"" << store_dir << "\": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        storing.store(true, std::memory_order_relaxed);
+        std::cerr << "Storing the blocks in \"" << store_dir << "\" (segments of " << segment_mb << " MB)" << std::endl;
     }
 
-    std::string readcharbuf;
-    while (true) {
-        char buf[512];
-        int n = read(fd, buf, 512); // blocking read, return buf with 1..512 bytes in it
-        assert(n > 0);              // Just stop if we get 0 or negative (=error)
-        readcharbuf.append(buf, n); // Append the Received bytes to the end of the existing std::string buffer
+    for (auto &dev : devices) {
 
-        // From: VE.Direct-Protocol-3.32.pdf
-        // " Some products will send Asynchronous HEX-messages, starting with “:A” and ending with a
-        //   newline ‘\n’, on their own. These messages can interrupt a regular Text-mode frame. "
-        {
-            // Remove any HEX-messages from the readcharbuf.
-            size_t starthex, endhex;
-            while ((starthex = readcharbuf.find(":A")) != std::string::npos && (endhex = readcharbuf.find("\n", starthex)) != std::string::npos) {
-                readcharbuf.erase(starthex, endhex - starthex + 1);
-            }
+        // Print serial device name with double quotes.
+        std::cerr << (dev->replay ? "Using replay file: \"" : "Using serial device: \"") << dev->path << "\"";
+        if (print_labels)
+            std::cerr << " with label \"" << dev->label << "\"";
+        std::cerr << std::endl;
+        if (dev->filter.all)
+            std::cerr << "No white list filter used" << std::endl;
+        else
+            std::cerr << "Using white list filter: \"" << dev->filter.names << "\"" << std::endl;
+
+        dev->parser.keep_errors(recover_errors);
+        print_device(*dev);
+        if (aggregate_window.count() > 0)
+            start_window(*dev, clock_ns(CLOCK_REALTIME));
+        if (dev->replay) {
+            if (!replay(*dev, realtime))
+                return -1;
+            continue;
         }
-        size_t startcheck;
-        // Find the "Checksum" message so we know where a block ends. Assume the start of a block is at index 0 in the readcharbuf (this probably not the case the first time when we start reading)
-        // Makes sure the readcharbuf length is big enough to contain the "Checksum\t" message and the checksum byte
-        while (((startcheck = readcharbuf.find("Checksum\t")) != std::string::npos) && (readcharbuf.length() >= startcheck + constexpr_strlen("Checksum\t") + 1)) {
-
-            // Extract the checksum block from the readcharbuf and remove it from the readcharbuf
-            auto block = readcharbuf.substr(0, startcheck + constexpr_strlen("Checksum\t") + 1); //  +1 for the actual checksum byte
-            readcharbuf.erase(0, startcheck + constexpr_strlen("Checksum\t") + 1);
-            received_bytes += block.length();
-
-            // Calculate the modulo 256 sum of all the bytes in this block
-            // The used checksum is very weak, e.g. if 2 characters have a bit-7 flip, it cannot be detected.
-            unsigned char sum = 0;
-            for (std::size_t i = 0; i < block.length(); i++)
-                sum += block[i];
-
-            if (sum != 0) {
-                if (valid_blocks > 0)
-                    chksum_errors++;
-                print_error_info("ERROR checksum, block discarded.");
-                continue;
-            }
+        if (!open_serial(*dev))
+            return -1;
+        if (dev->device_path != dev->path)
+            std::cerr << "Serial device \"" << dev->path << "\" is \"" << dev->device_path << "\"" << std::endl;
 
-            // Get rid of the checksum line (the checksum identifier and value have no further use)
-            block.erase(startcheck);
-            // The block now ends with \r\n (this is what we want)
-            // Delete the first \r\n of this block.
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = dev.get();
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, dev->fd, &ev) != 0) {
+            std::cerr << "Error adding \"" << dev->path << "\" to epoll: " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+
+    if (devices.front()->replay) {
+        if (thread_count > 0)
+            std::cerr << "Option --threads is ignored for a replay" << std::endl;
+        if (!poll_registers.empty())
+            std::cerr << "Option --poll is ignored for a replay" << std::endl;
+        close(epfd);
+        store.close();
+        if (metrics.timeout_ms() != -1)
+            metrics.dump(metrics_text(devices));
+        return 0;
+    }
+
+    // Watch for (re)appearing device nodes, so a disconnected device is back within milliseconds.
+    // That is /dev (a USB adapter that is plugged in again), and the directory of every device path (e.g. a symlink).
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd != -1) {
+        inotify_add_watch(inotify_fd, "/dev", IN_CREATE | IN_ATTRIB | IN_MOVED_TO);
+        for (auto &dev : devices) {
+            auto slash = dev->path.rfind('/');
+            if (slash != std::string::npos)
+                inotify_add_watch(inotify_fd, slash == 0 ? "/" : dev->path.substr(0, slash).c_str(), IN_CREATE | IN_ATTRIB | IN_MOVED_TO);
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &inotify_fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, inotify_fd, &ev);
+    }
 
-            // Check if the first 2 characters are \r\n
-            if (block[0] != '\r' || block[1] != '\n') {
-                if (valid_blocks > 0)
-                    format_errors++;
-                print_error_info("ERROR format, first 2 characters of block are not \\r\\n, block discarded.");
+    if (thread_count > 0) {
+        start_pipeline(devices, thread_count);
+        std::cerr << "Using " << workers.size() << (workers.size() == 1 ? " worker thread" : " worker threads") << std::endl;
+        if (aggregate_window.count() > 0)
+            schedule_tick(clock_ns(CLOCK_REALTIME));
+    }
+
+    if (metrics.fd() != -1) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &metrics;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, metrics.fd(), &ev) != 0) {
+            std::cerr << "Error adding the metrics socket to epoll: " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+
+    // One event loop serves all devices
+    while (!stop_requested) {
+        epoll_event events[16];
+        int n = epoll_wait(epfd, events, 16, wait_timeout_ms(devices));
+        if (n == -1) {
+            if (errno == EINTR)
                 continue;
+            std::cerr << "Error waiting for the serial devices: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        bool hotplug = false;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &metrics) {
+                metrics.serve(metrics_text(devices));
+            } else if (events[i].data.ptr == &inotify_fd) {
+                // Which file appeared doesn't matter, every disconnected device gets a try
+                char buf[4096];
+                while (read(inotify_fd, buf, sizeof(buf)) > 0)
+                    ;
+                hotplug = true;
+            } else {
+                read_device(*static_cast<Device *>(events[i].data.ptr));
             }
-            block.erase(0,2);
-
-            // Extract line by line from the block and check if the line matches the grammar
-            // If there is a grammer error, discard the whole block (we cannot trust anything in this block)
-            {
-                bool format_error = false;
-                std::istringstream iss{block};
-                std::string line;
-                while (std::getline(iss, line)) {
-                    if (!std::regex_search(line, ve_direct_line_regex)) {
-                        format_error = true;
-                        break;
-                    }
-                }
-                if (format_error) {
-                    // Remove any \r characters in the line (it messes up the output)
-                    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-                    if (valid_blocks > 0)
-                        format_errors++;
-                    print_error_info("ERROR format, line \"" + line + "\", block discarded.");
-                    continue;
-                }
+        }
+        auto steady_now = std::chrono::steady_clock::now();
+        for (auto &dev : devices) {
+            if (dev->fd == -1 && (hotplug || steady_now >= dev->next_reconnect))
+                reconnect_serial(*dev, epfd);
+        }
+        if (!poll_registers.empty()) {
+            for (auto &dev : devices) {
+                if (dev->fd != -1)
+                    poll_device(*dev);
             }
-
-            valid_blocks++;
-
-            std::istringstream iss{block};
-            std::string line;
-            while (std::getline(iss, line)) {   // getline removes the \n character at the end of the line
-                // Remove \r character at the end (this is Linux so we use \n which will be added by std::cout)
-                assert(line.back()=='\r');
-                line.erase(line.end() - 1);
-
-                size_t tab_pos = line.find('\t');
-                assert(tab_pos != std::string::npos);
-                std::string name = line.substr(0, tab_pos);
-                assert(name.size() > 0);
-                std::string value = line.substr(tab_pos + 1);
-                assert(value.size() > 0);
-
-                if (filter.empty() || filter.find(',' + name + ',') != std::string::npos) {
-                    std::cout << name << '\t' << value << std::endl;
-                }
+        }
+        if (metrics.dump_due())
+            metrics.dump(metrics_text(devices));
+        if (aggregate_window.count() > 0 && !workers.empty()) {
+            auto now = clock_ns(CLOCK_REALTIME);
+            if (now >= next_tick_ns) {
+                // A full queue only delays the tick, the worker also closes the window with the next block
+                for (auto &worker : workers)
+                    send_to_worker(*worker, InputChunk::Kind::Tick, nullptr);
+                schedule_tick(now);
+            }
+        } else if (aggregate_window.count() > 0) {
+            // Also close the windows of devices that don't send anything
+            auto now = clock_ns(CLOCK_REALTIME);
+            for (auto &dev : devices) {
+                if (now >= dev->aggregator.end_ns)
+                    close_window(*dev, now);
             }
         }
+        output.poll();
+    }
+    if (!workers.empty()) {
+        stop_pipeline();
+    } else {
+        for (auto &dev : devices)
+            finish_window(*dev);
+        output.flush();
+    }
+    if (!poll_registers.empty()) {
+        for (auto &dev : devices)
+            print_poll_statistics(*dev);
     }
+    store.close();
+    if (metrics.timeout_ms() != -1)
+        metrics.dump(metrics_text(devices));
 
-    flock(fd, LOCK_UN);
-    close(fd);
+    for (auto &dev : devices)
+        close_serial(*dev);
+    if (inotify_fd != -1)
+        close(inotify_fd);
+    close(epfd);
     return 0;
 }
@@ -0,0 +1,129 @@
+
+/*
+ * ----------------------------------------------------------------------------
+ * Author: Ronald van Immerzeel
+ * Version: V1.0, 2026-10-16
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ * ----------------------------------------------------------------------------
+ *
+ * This software is dedicated to the public domain under the CC0 1.0 Universal
+ * (CC0 1.0) Public Domain Dedication. To the extent possible under law, the
+ * author(s) have dedicated all copyright and related and neighboring rights
+ * to this software to the public domain worldwide. This software is
+ * distributed without any warranty.
+ *
+ * <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+// vicshm: print the last values that vicread publishes in shared memory (vicread --shm=<name>).
+// Reading doesn't need any locks or syscalls (see veshm.h), so any number of vicshm's and other readers can run
+// next to the one vicread process that owns the serial port.
+
+// C++ header files
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <thread>
+
+// C header files
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include "vedirect.h"
+#include "vebinary.h"
+#include "veshm.h"
+
+int main(int argc, char *argv[])
+{
+    std::string name = "/vicread";
+    std::string device;
+    long watch_ms = 0;
+    FieldFilter filter;
+    for (int argnr = 1; argnr < argc; argnr++) {
+        std::string_view arg = argv[argnr];
+        if (arg.starts_with("--shm=")) {
+            name = arg.substr(constexpr_strlen("--shm="));
+            if (!name.starts_with('/'))
+                name.insert(0, "/");
+        } else if (arg.starts_with("--device=")) {
+            device = arg.substr(constexpr_strlen("--device="));
+        } else if (arg.starts_with("--watch=")) {
+            watch_ms = std::atol(arg.data() + constexpr_strlen("--watch="));
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Usage: " << argv[0] << " [--shm=<name>] [--device=<label>] [--watch=<ms>] [<white_list_filter>]" << std::endl;
+            std::cerr << "Prints the last values that vicread publishes in shared memory (vicread --shm=<name>)." << std::endl;
+            std::cerr << "  --shm=<name>      Name of the shared memory (default vicread)" << std::endl;
+            std::cerr << "  --device=<label>  Only this device" << std::endl;
+            std::cerr << "  --watch=<ms>      Print the values again every <ms> milliseconds" << std::endl;
+            return -1;
+        } else {
+            // Same as vicread: commas and/or spaces separate the names
+            while (!arg.empty()) {
+                auto sep = arg.find_first_of(", ");
+                if (sep != 0)
+                    filter.add(arg.substr(0, sep));
+                arg.remove_prefix(sep == std::string_view::npos ? arg.size() : sep + 1);
+            }
+        }
+    }
+
+    ShmReader reader;
+    if (!reader.open(name)) {
+        std::cerr << "Error opening the shared memory \"" << name << "\": "
+                  << (errno == EPROTO ? "not written by a compatible vicread" : std::strerror(errno)) << std::endl;
+        return -1;
+    }
+
+    ShmDeviceData snapshot;
+    std::string out;
+    for (;;) {
+        out.clear();
+        for (std::size_t i = 0; i < reader.device_count(); i++) {
+            if (!reader.snapshot(i, snapshot)) {
+                std::cerr << "Device " << i << " is inconsistent, vicread stopped while it updated the values" << std::endl;
+                continue;
+            }
+            std::string_view label(snapshot.label, strnlen(snapshot.label, sizeof(snapshot.label)));
+            if (!device.empty() && label != device)
+                continue;
+            for (int id = 0; id < field_count; id++) {
+                auto const &value = snapshot.values[id];
+                if (value.state == 0)
+                    continue;
+                Field field{};
+                field.id = id;
+                field.name = field_dictionary[id].label;
+                if (!filter.accepts(field))
+                    continue;
+                char buf[32];
+                if (reader.device_count() > 1) {
+                    out += label;
+                    out += '\t';
+                }
+                out += field.name;
+                out += '\t';
+                out += format_value(shm_field(id, value), buf);
+                out += '\n';
+            }
+        }
+        if (!reader.writer_running())
+            std::cerr << "vicread has stopped, these are the last values" << std::endl;
+        std::cout << out << std::flush;
+        if (watch_ms <= 0)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(watch_ms));
+    }
+    return 0;
+}